@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include "Image.hpp"
+#include "RGB.hpp"
+#include "render_config.hpp"
+
+class Scene;
+class PinholeCamera;
+class ThreadPool;
+
+/**
+ * Running statistics of the samples of one pixel (Welford's algorithm).
+ * The mean is kept per channel; the variance, which decides convergence,
+ * is that of the sample luminance.
+ */
+struct PixelStats {
+    unsigned count = 0;
+    double r = 0, g = 0, b = 0;     // Mean of each channel
+    double luminance = 0;           // Mean luminance
+    double m2 = 0;                  // Sum of squared luminance deviations
+
+    void add(const RGB& sample);
+
+    RGB mean() const { return RGB(float(r), float(g), float(b)); }
+    // Unbiased variance of the luminance, 0 with less than two samples
+    double variance() const { return count > 1 ? m2 / (count - 1) : 0.0; }
+    // Half width of the 95% confidence interval of the mean luminance
+    double errorBound() const;
+    // True once errorBound() is below relativeError times the mean luminance
+    bool converged(double relativeError) const;
+};
+
+/**
+ * Adaptive sampling: every pixel takes config.adaptiveMinSamples samples, then
+ * only pixels that have not converged keep sampling, in rounds that double their
+ * sample count, until the budget of samplesPerPixel * width * height samples is
+ * spent or every pixel has converged. Tiles with no pixel left are not queued.
+ * The sample indices of each pixel continue from its count, so the image does
+ * not depend on the number of threads.
+ */
+class AdaptiveSampler {
+public:
+    struct Result {
+        Image image;
+        Image heatmap;                  // Samples per pixel, black to white
+        std::vector<unsigned> samples;  // Samples taken by each pixel
+    };
+
+    // In parallel mode the rounds run on pool, or on ThreadPool::shared() if it is null
+    static Result render(const PinholeCamera& camera, const Scene& scene,
+                         unsigned samplesPerPixel, const RenderConfig& config, ThreadPool* pool = nullptr);
+
+    // Maps each count to a black body ramp scaled by the largest count
+    static Image heatmap(const std::vector<unsigned>& samples, int width, int height);
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "geometry.hpp"
+
+class Object3D;
+class Ray;
+struct HitRecord;
+struct RayPacket;
+struct PacketHits;
+
+/**
+ * Axis aligned bounding box
+ */
+struct AABB {
+    Point min, max;
+
+    AABB();
+    AABB(const Point& min, const Point& max) : min(min), max(max) {}
+
+    void expand(const Point& p);
+    void expand(const AABB& box);
+
+    Point centroid() const;
+    float surfaceArea() const;
+    bool isInfinite() const;
+
+    static AABB infinite();
+};
+
+// Node of a flat hierarchy stored in depth-first order: the left child of an
+// interior node is always the next node
+struct BVHNode {
+    float bmin[3], bmax[3];
+    uint32_t offset;    // First primitive (leaf) or right child (interior)
+    uint16_t count;     // Number of primitives, 0 for interior nodes
+    uint16_t axis;      // Split axis, used to pick the near child first
+};
+
+// Ray data precomputed once for all the slab tests of a traversal
+struct BoxRay {
+    float origin[3];
+    float invDir[3];
+    bool negative[3];
+
+    BoxRay(const Point& origin, const Direction& direction);
+
+    // True if the ray enters the node before tmax
+    bool hits(const BVHNode& node, float tmax) const {
+        float tmin = 0.0f;
+        for (int k = 0; k < 3; k++) {
+            float t0 = (node.bmin[k] - origin[k]) * invDir[k];
+            float t1 = (node.bmax[k] - origin[k]) * invDir[k];
+            if (negative[k]) std::swap(t0, t1);
+            tmin = t0 > tmin ? t0 : tmin;
+            tmax = t1 < tmax ? t1 : tmax;
+            if (tmin > tmax) return false;
+        }
+        return true;
+    }
+};
+
+// Entries of the traversal stacks. buildSAH keeps every leaf shallower than that:
+// from depth BVH_STACK_SIZE / 2 down it splits at the median instead of the SAH plane,
+// so lopsided splits cannot make a hierarchy deeper than the stacks that walk it
+constexpr int BVH_STACK_SIZE = 64;
+
+/**
+ * Binned SAH build over a set of bounded boxes. On return every leaf of 'nodes'
+ * covers the range [offset, offset + count) of 'order', which is the permutation
+ * of the input boxes. leafWidth is the number of primitives a leaf tests at once
+ * (1 for scalar leaves, the SIMD width for packed triangles); leaves never hold
+ * more than maxLeafSize primitives.
+ */
+void buildSAH(const std::vector<AABB>& boxes, int maxLeafSize, int leafWidth,
+              std::vector<BVHNode>& nodes, std::vector<uint32_t>& order);
+
+/**
+ * Bounding volume hierarchy over the bounded primitives of a scene.
+ * It is built with the binned surface area heuristic and stored as a flat
+ * array of nodes in depth-first order (the left child of a node is always the
+ * next node). Unbounded primitives (planes) are kept in a side list that is
+ * tested linearly for every ray.
+ */
+class BVH {
+public:
+    BVH() = default;
+
+    // materialIds[i] is the material of objects[i], copied into the hit records
+    void build(const std::vector<std::shared_ptr<Object3D>>& objects, const std::vector<uint32_t>& materialIds);
+
+    // Closest hit closer than maxDistance. Ties are resolved in favour of the
+    // primitive that was added first to the scene, like a linear scan would.
+    std::optional<HitRecord> intersect(const Ray& ray, float maxDistance) const;
+    // Any hit closer than maxDistance, stops at the first one found
+    bool occluded(const Ray& ray, float maxDistance) const;
+    // Closest hits of a packet, same results as intersect on every ray. Nodes are
+    // tested for simd::WIDTH rays at a time and only the rays that enter a node go on
+    void intersectPacket(const RayPacket& packet, PacketHits& hits) const;
+
+    size_t primitiveCount() const { return primitives.size() + unbounded.size(); }
+    size_t nodeCount() const { return nodes.size(); }
+
+private:
+    struct PrimitiveRef {
+        const Object3D* object;
+        uint32_t index;     // Position in Scene::objects, used to break ties
+        uint32_t material;
+    };
+
+    static constexpr int MAX_LEAF_SIZE = 4;
+
+    std::vector<BVHNode> nodes;
+    std::vector<PrimitiveRef> primitives;
+    std::vector<PrimitiveRef> unbounded;
+};
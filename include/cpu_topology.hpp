@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+
+/**
+ * Logical CPUs of the machine with their NUMA node, socket and core, read from
+ * sysfs. Where sysfs is missing everything is one node with
+ * std::thread::hardware_concurrency() CPUs.
+ */
+struct CpuTopology {
+    struct Cpu {
+        int id;
+        int node;
+        int package;    // Socket
+        int core;
+    };
+
+    std::vector<Cpu> cpus;      // Node by node, then core by core
+    int numNodes = 1;
+
+    // root is normally /sys/devices/system; tests point it at a fake tree
+    static CpuTopology discover(const std::string& root = "/sys/devices/system");
+    // Topology of this machine, discovered once
+    static const CpuTopology& system();
+
+    // CPU for each of numWorkers workers: evenly spread over the CPUs in the order of
+    // cpus, so consecutive workers share a node and nodes get the same share.
+    // With more workers than CPUs, consecutive workers share a CPU
+    std::vector<int> placement(int numWorkers) const;
+    int nodeOf(int cpu) const;
+};
+
+/**
+ * Pins the calling thread to one CPU and gives it its previous affinity back
+ * when destroyed. pinned() is false if the CPU could not be set.
+ */
+class ScopedAffinity {
+public:
+    explicit ScopedAffinity(int cpu);
+    ~ScopedAffinity();
+
+    ScopedAffinity(const ScopedAffinity&) = delete;
+    ScopedAffinity& operator=(const ScopedAffinity&) = delete;
+
+    bool pinned() const { return pinned_; }
+
+private:
+    cpu_set_t previous_;
+    bool restore_ = false;
+    bool pinned_ = false;
+};
+
+/**
+ * Gives the whole pages inside [data, data + bytes) back to the kernel, so the next
+ * write to each one allocates it on the NUMA node of the writing thread. The memory
+ * must be anonymous (heap) and reads as zeros afterwards; the partial pages at both
+ * ends are left as they are. False if the kernel refused.
+ */
+bool releasePages(void* data, std::size_t bytes);
@@ -1,57 +1,126 @@
 #pragma once
 
-#include <list>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <thread>
+#include <vector>
 #include "geometry.hpp"
 #include "RGB.hpp"
-#include "kdtree.h"
 
-// TODO: Refactorizar los nombres de esta clase
+/*
+ *  Fotón empaquetado en 8 bytes: dirección codificada en un octaedro (dos enteros de
+ *  16 bits) y flujo RGBE (tres mantisas de 8 bits con un exponente común, como en los
+ *  ficheros de Radiance). La dirección se guarda normalizada y el flujo con un error
+ *  relativo por debajo de 1/256 del canal mayor. La posición no va aquí: el mapa la
+ *  guarda en sus arrays x, y, z y un fotón recién emitido la lleva en FotonEmitido.
+ */
 class Foton {
     public:
-    Point posicion;
-    Direction direccion;
-    RGB flujo;
-
-    Foton(Point p, Direction d, RGB f) : posicion(p), direccion(d), flujo(f) {}
-    ~Foton() {}
-
-    double position(std::size_t i) const {
-        switch(i) {
-            case 0: return posicion.x;
-            case 1: return posicion.y;
-            case 2: return posicion.z;
-            default: throw std::out_of_range("Index out of range for Point");
-        }
-    }
+    Foton(const Direction& d, const RGB& f);
+
+    Direction direccion() const;
+    RGB flujo() const;
+
+    private:
+    uint8_t rgbe[4];
+    uint16_t octaedro[2];
 };
 
-struct PosicionEjeFoton {
-    float operator()(const Foton& p, std::size_t i) const {
-        return p.position(i);
-    }
+static_assert(sizeof(Foton) == 8, "Foton debe ocupar 8 bytes");
+
+// Fotón tal como sale del trazado, con su posición en floats: 20 bytes. Solo vive
+// hasta que se construye el mapa, que separa las posiciones y se queda con el Foton
+struct FotonEmitido {
+    float pos[3];
+    Foton foton;
+
+    FotonEmitido(const Point& p, const Direction& d, const RGB& f) : pos{p.x, p.y, p.z}, foton(d, f) {}
+
+    Point posicion() const { return Point(pos[0], pos[1], pos[2]); }
 };
 
-using MapaFotones = nn::KDTree<Foton,3,PosicionEjeFoton>;
+static_assert(sizeof(FotonEmitido) == 20, "FotonEmitido debe ocupar 20 bytes");
 
-inline MapaFotones construirMapaFotones(std::list<Foton> fotones) {
-    return MapaFotones(fotones, PosicionEjeFoton());
-}
+// Fotón encontrado por una búsqueda, con su distancia al cuadrado al punto buscado
+struct FotonCercano {
+    float distance2;
+    const Foton* foton;
+};
+
+// Resultado de una búsqueda: cuántos fotones se han escrito y la distancia al cuadrado
+// del más lejano de ellos (0 si no hay ninguno)
+struct BusquedaFotones {
+    std::size_t encontrados;
+    float radio2;
+};
 
 /*
-void search_nearest(MapaFotones map, ...){
-    // Position to look for the nearest photons
-    Point query_position = ...;    
+ *  Árbol kd equilibrado sobre los fotones, guardado de forma implícita como el de
+ *  nn::KDTree: el nodo de [left, right) es el elemento (left+right)/2. Las
+ *  posiciones están solo en tres arrays (x, y, z) en el orden del árbol, así la
+ *  búsqueda solo lee esos arrays y el eje de cada nodo hasta aceptar un fotón, y
+ *  cada fotón ocupa 21 bytes: 8 del Foton, 12 de la posición y 1 del eje.
+ */
+class MapaFotones {
+    public:
+    MapaFotones() = default;
+    // Consume los fotones emitidos: los ordena como el árbol, separa las posiciones y
+    // libera el vector. Con varios hilos los subárboles grandes se construyen en
+    // paralelo, el árbol es el mismo con cualquier número de hilos
+    explicit MapaFotones(std::vector<FotonEmitido>&& emitidos, unsigned hilos = 1);
+
+    // Un mapa puede ocupar cientos de megas: se mueve o se comparte por referencia,
+    // nunca se copia
+    MapaFotones(const MapaFotones&) = delete;
+    MapaFotones& operator=(const MapaFotones&) = delete;
+    MapaFotones(MapaFotones&&) = default;
+    MapaFotones& operator=(MapaFotones&&) = default;
+
+    // Escribe en vecinos los vecinos.size() fotones más cercanos a p a menos de maxDistance,
+    // como un montículo de máximos: vecinos[0] es el más lejano. No reserva memoria
+    BusquedaFotones nearest_neighbors(const Point& p, float maxDistance, std::span<FotonCercano> vecinos) const;
 
-    // Maximum number of photons to look for
-    unsigned long nphotons_estimate = ...;
+    // Todos los fotones a menos de radio de p, sin límite de número: vacía vecinos y los
+    // escribe en él sin orden. radio2 es radio^2 y no la distancia del más lejano, que es
+    // lo que necesita una estimación con radio fijo como la del photon mapping progresivo
+    BusquedaFotones en_radio(const Point& p, float radio, std::vector<FotonCercano>& vecinos) const;
+
+    // Los k fotones más cercanos a p a menos de maxDistance, sin orden
+    std::vector<const Foton*> nearest_neighbors(const Point& p, std::size_t k,
+                                                float maxDistance = std::numeric_limits<float>::infinity()) const;
+
+    // Posición de un fotón devuelto por una búsqueda, leída de los arrays por su índice
+    Point posicion(const Foton* foton) const {
+        std::size_t i = std::size_t(foton - fotones.data());
+        return Point(x[i], y[i], z[i]);
+    }
 
-    // Maximum distance to look for photons
-    float radius_estimate = ...;
+    std::size_t size() const { return fotones.size(); }
+    // Tiempo de construcción del árbol, en segundos
+    double build_time() const { return buildSeconds; }
+    std::size_t memoryUsage() const;
+
+    private:
+    std::vector<Foton> fotones;
+    std::vector<float> x, y, z;
+    std::vector<uint8_t> ejes;   // Eje de corte de cada nodo
+    double buildSeconds = 0.0;
+
+    void construir(std::vector<FotonEmitido>& emitidos, std::size_t left, std::size_t right,
+                   std::array<float, 3> bbmin, std::array<float, 3> bbmax, unsigned hilos);
+};
+
+// Mapa global y mapa de cáusticas de una misma pasada de fotones
+struct MapasFotones {
+    MapaFotones global;
+    MapaFotones causticos;
+};
 
-    // nearest is the nearest photons returned by the KDTree
-    auto nearest = map.nearest_neighbors(query_position,
-                                         nphotons_estimate,
-                                         radius_estimate)
+// El mapa consume el vector de fotones emitidos y construye el árbol con varios
+// hilos; mapa.build_time() devuelve lo que ha tardado
+inline MapaFotones construirMapaFotones(std::vector<FotonEmitido>&& emitidos,
+                                        unsigned hilos = std::thread::hardware_concurrency()) {
+    return MapaFotones(std::move(emitidos), hilos);
 }
-                                         
-*/
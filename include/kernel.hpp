@@ -1,60 +1,101 @@
 #pragma once
 
-class Kernel {
-    public:
-    Kernel() {};
-    // Cada kernel debe implementar su funcion de evaluacion
-    virtual double evaluar(double radioFoton, double radioMax) = 0;
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <variant>
+
+/*
+ *  Kernels de la estimación de densidad de fotones. Cada uno es una función de
+ *  u = r / rMax en [0, 1], normalizada sobre el disco unidad (la integral de
+ *  K(|x|) en |x| <= 1 vale 1), así el peso de un fotón a distancia r es
+ *  K(r / rMax) / rMax^2 y la estimación no cambia de escala con el radio.
+ *
+ *  No son virtuales: Kernel es un std::variant y la estimación se instancia para
+ *  cada tipo, de modo que el kernel se elige una vez por búsqueda y no por fotón.
+ */
+
+struct KernelCaja {
+    float operator()(float) const { return float(1.0 / M_PI); }
 };
 
-class KernelCaja : public Kernel {
-    public:
-    double evaluar(double radioFoton, double radioMax);
+struct KernelTriangular {
+    float operator()(float u) const { return float(3.0 / M_PI) * (1.0f - u); }
 };
 
-class KernelTriangular : public Kernel {
-    public:
-    double evaluar(double radioFoton, double radioMax);
+struct KernelGaussiano {
+    float sigma;
+    float normalizacion;
+
+    // sigma relativa al radio, el kernel se trunca en u = 1
+    KernelGaussiano(float s = 1.0f)
+        : sigma(s), normalizacion(float(1.0 / (2.0 * M_PI * s * s * (1.0 - std::exp(-1.0 / (2.0 * s * s)))))) {}
+
+    float operator()(float u) const { return normalizacion * std::exp(-u * u / (2.0f * sigma * sigma)); }
 };
 
-class KernelGaussiano : public Kernel {
-    double sigma;
-    public:
-    KernelGaussiano(double s = 1) : sigma(s) {};
-    double evaluar(double radioFoton, double radioMax);
+struct KernelEpanechnikov {
+    float operator()(float u) const { return float(2.0 / M_PI) * (1.0f - u * u); }
 };
 
-class KernelEpanechnikov : public Kernel {
-    public:
-    double evaluar(double radioFoton, double radioMax);
+struct KernelQuartic {
+    float operator()(float u) const {
+        float t = 1.0f - u * u;
+        return float(3.0 / M_PI) * t * t;
+    }
 };
 
-class KernelQuartic : public Kernel {
-    public:
-    double evaluar(double radioFoton, double radioMax);
+struct KernelTripeso {
+    float operator()(float u) const {
+        float t = 1.0f - u * u;
+        return float(4.0 / M_PI) * t * t * t;
+    }
 };
 
-class KernelTripeso : public Kernel {
-    public:
-    double evaluar(double radioFoton, double radioMax);
+struct KernelTricubo {
+    float operator()(float u) const {
+        float t = 1.0f - u * u * u;
+        return float(220.0 / (81.0 * M_PI)) * t * t * t;
+    }
 };
 
-class KernelTricubo : public Kernel {
-    public:
-    double evaluar(double radioFoton, double radioMax);
-};  
+struct KernelCoseno {
+    float operator()(float u) const { return float(M_PI / (4.0 * M_PI - 8.0)) * std::cos(float(M_PI / 2) * u); }
+};
 
-class KernelCoseno : public Kernel {
-    public:
-    double evaluar(double radioFoton, double radioMax);
+// Las normalizaciones de estos dos se han calculado numéricamente
+struct KernelLogistico {
+    float operator()(float u) const { return 1.4345511f / (std::exp(u) + 2.0f + std::exp(-u)); }
 };
 
-class KernelLogistico : public Kernel {
-    public:
-    double evaluar(double radioFoton, double radioMax);
+struct KernelSigmoide {
+    float operator()(float u) const { return 0.7923978f / (std::exp(u) + std::exp(-u)); }
 };
 
-class KernelSigmoide : public Kernel {
+/*
+ *  Cualquiera de los anteriores muestreado en TAMANO + 1 puntos de [0, 1] e
+ *  interpolado linealmente: evita exp y cos en los kernels que los usan.
+ */
+class KernelTabulado {
     public:
-    double evaluar(double radioFoton, double radioMax);
+    static constexpr int TAMANO = 256;
+
+    template <typename K>
+    explicit KernelTabulado(const K& kernel) {
+        for (int i = 0; i <= TAMANO; i++) tabla[i] = kernel(float(i) / TAMANO);
+    }
+
+    float operator()(float u) const {
+        float x = std::fmin(std::fmax(u, 0.0f), 1.0f) * TAMANO;
+        int i = std::min(int(x), TAMANO - 1);
+        float t = x - float(i);
+        return tabla[i] + (tabla[i + 1] - tabla[i]) * t;
+    }
+
+    private:
+    std::array<float, TAMANO + 1> tabla;
 };
+
+using Kernel = std::variant<KernelCaja, KernelTriangular, KernelGaussiano, KernelEpanechnikov, KernelQuartic,
+                            KernelTripeso, KernelTricubo, KernelCoseno, KernelLogistico, KernelSigmoide,
+                            KernelTabulado>;
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Vertex and index buffers in the layout taken by TriangleMesh
+struct MeshData {
+    std::vector<float> positions;   // x, y, z of every vertex
+    std::vector<uint32_t> indices;  // Three vertices per triangle
+};
+
+/*
+ *  Loads a triangle mesh from a Wavefront OBJ or a PLY file (ASCII or binary
+ *  little-endian), chosen by the extension. The file is memory-mapped and parsed
+ *  in place, without building a string per line. Only positions and faces are
+ *  read, and polygons are split into triangle fans. Returns nullopt and prints
+ *  the reason if the file cannot be loaded.
+ */
+std::optional<MeshData> loadMesh(const std::string& path);
+std::optional<MeshData> loadOBJ(const std::string& path);
+std::optional<MeshData> loadPLY(const std::string& path);
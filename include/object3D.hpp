@@ -4,16 +4,25 @@
 #include <vector>
 #include <memory>
 #include <string>
-#include <list>
 #include <fstream>
 #include <sstream>
+#include <mutex>
+#include <thread>
+#include <filesystem>
+#include <iostream>
+#include <unordered_map>
 
 #include "geometry.hpp"
+#include "bvh.hpp"
 #include "RGB.hpp"
 #include "foton.hpp"
 #include "kernel.hpp"
 #include "utils.hpp"
+#include "sampler.hpp"
+#include "mesh_loader.hpp"
 
+struct RayPacket;
+struct PacketHits;
 
 struct Material {
     RGB diffuse; // Color difuso
@@ -57,14 +66,27 @@ struct Material {
 
 };
 
+// Minimal record kept while looking for the closest hit
+struct HitRecord {
+    float distance;
+    uint32_t primitiveId;   // Index in Scene::objects
+    uint32_t materialId;    // Index in Scene::materials
+    uint32_t elementId = 0; // Element hit inside the primitive (triangle of a mesh)
+};
+
+// Shading data, only built for the closest hit
 struct Intersection {
     float distance;
     Point point;
     Direction normal;
-    Material material;
-
-    Intersection(const float distance, const Point& point, const Direction& normal, const Material& material) :
-        distance(distance), point(point), normal(normal), material(material) {}
+    const Material* material;   // Entry of the scene material table
+    uint32_t primitiveId;
+    uint32_t materialId;
+
+    Intersection(const float distance, const Point& point, const Direction& normal, const Material* material,
+                 uint32_t primitiveId = 0, uint32_t materialId = 0) :
+        distance(distance), point(point), normal(normal), material(material),
+        primitiveId(primitiveId), materialId(materialId) {}
 };
 
 class Ray {
@@ -87,7 +109,36 @@ public:
     Object3D(const Material& material) : material(material) {}
 
     virtual std::string toString() const = 0;
-    virtual std::optional<Intersection> intersect(const Ray& ray) const = 0;   
+
+    // Distance to the closest hit in front of the ray, without any shading data
+    virtual std::optional<float> hitDistance(const Ray& ray) const = 0;
+    // Same, also reporting which element of the object was hit. Only objects made
+    // of several elements (TriangleMesh) need to override it
+    virtual std::optional<float> hitElement(const Ray& ray, uint32_t& element) const {
+        element = 0;
+        return hitDistance(ray);
+    }
+    // Surface normal at a point returned by hitDistance. Objects made of several
+    // elements may not support it, shading code always calls normalAtElement
+    virtual Direction normalAt(const Point& point) const = 0;
+    virtual Direction normalAtElement(const Point& point, uint32_t element) const {
+        (void)element;
+        return normalAt(point);
+    }
+    // Any hit closer than maxT, for shadow rays
+    virtual bool intersectsP(const Ray& ray, float maxT) const;
+
+    // Packet version of hitElement for the rays selected by 'active': writes the distance
+    // and element of every ray that hits and returns their mask. t and element must hold
+    // RayPacket::MAX_RAYS entries. By default the rays are traced one by one
+    virtual uint64_t hitPacket(const RayPacket& packet, uint64_t active, float* t, uint32_t* element) const;
+
+    // Full hit against this object alone, the material is the object's own
+    std::optional<Intersection> intersect(const Ray& ray) const;
+
+    // Bounds used by the BVH. Unbounded objects are tested for every ray
+    virtual AABB boundingBox() const = 0;
+    virtual bool isBounded() const { return true; }
 };
 
 class PointLight {
@@ -110,16 +161,34 @@ public:
 
     std::vector<std::shared_ptr<Object3D>> objects;
     std::vector<std::shared_ptr<PointLight>> lights;
+    std::vector<Material> materials; // Filled by addObject, referenced by id from the hits
     RGB backgroundColor = RGB(0, 0, 0); // Color de fondo por defecto
 
     void addObject(const std::shared_ptr<Object3D>& object);
     void addLight(const std::shared_ptr<PointLight>& light);
+    uint32_t addMaterial(const Material& material);
+
+    std::optional<HitRecord> closestHit(const Ray& ray, const float distance = 1000.0f) const;
+    // Closest hits of a packet of rays, the maximum distance is the one hits starts with
+    void closestHitPacket(const RayPacket& packet, PacketHits& hits) const;
+    Intersection surfaceAt(const Ray& ray, const HitRecord& hit) const;
     std::optional<Intersection> intersect(const Ray& ray, const float distance = 1000.0f) const;
+    // True as soon as any object is hit closer than maxT
+    bool occluded(const Ray& ray, float maxT) const;
     
     RGB calculateDirectLight(const Point& p) const;
-    MapaFotones generarMapaFotones(int nPaths, bool save, double sigma = 0.0f) const;
-    void reboteFoton(const Ray& ray, const RGB& light, std::list<Foton>& fotones, std::list<Foton>& causticos, bool esCaustico, bool save = false, double sigma = 0.0f) const;
-    RGB ecuacionRenderFotones(Point x, Direction wo, Material material, Direction n, MapaFotones mapa, int kFotones, double radio, bool guardar, Kernel* kernel, double sigma = 0.0f) const;
+    // Traza los paseos de los fotones con varios hilos; el mapa es el mismo con cualquier número de hilos
+    MapaFotones generarMapaFotones(int nPaths, bool save, double sigma = 0.0f, uint64_t seed = 0,
+                                   unsigned hilos = std::thread::hardware_concurrency(),
+                                   SamplerType muestreo = SamplerType::INDEPENDENT) const;
+    // Igual, pero los fotones que llegan a una superficie difusa tras un rebote especular o
+    // una refracción van a un mapa de cáusticas aparte
+    MapasFotones generarMapasFotones(int nPaths, double sigma = 0.0f, uint64_t seed = 0,
+                                     unsigned hilos = std::thread::hardware_concurrency(),
+                                     SamplerType muestreo = SamplerType::INDEPENDENT) const;
+    void reboteFoton(const Ray& ray, const RGB& light, std::vector<FotonEmitido>& fotones, std::vector<FotonEmitido>& causticos, bool esCaustico, Sampler& rng, bool save = false, double sigma = 0.0f) const;
+    RGB ecuacionRenderFotones(Point x, Direction wo, Material material, Direction n, const MapaFotones& mapa, int kFotones, double radio, bool guardar, const Kernel* kernel, Sampler& rng, double sigma = 0.0f,
+                              const MapaFotones* causticos = nullptr, int kCausticos = 0, double radioCausticos = 0.0) const;
     RGB estimacionSiguienteEvento(Point point, Direction wo, Material material, Direction n, double sigma) const;
  
     void sortObjectsByDistanceToCamera(const Point& cameraPosition); // No implementado
@@ -127,6 +196,25 @@ public:
 
     // Simple YAML-like scene loader (no external libs)
     static Scene fromYAML(const std::string& filename); // Declaration only
+
+private:
+    // The BVH is built lazily by the first intersect call and discarded by addObject.
+    // It lives behind a shared_ptr so that Scene stays copyable.
+    struct BVHCache {
+        std::once_flag built;
+        BVH bvh;
+    };
+    std::shared_ptr<BVHCache> bvhCache = std::make_shared<BVHCache>();
+    std::vector<uint32_t> objectMaterials; // Material id of every object
+    std::unordered_multimap<size_t, uint32_t> materialIds; // Ids in materials by hash, for addMaterial
+
+    const BVH& bvh() const;
+    // Fotones de nPaths paseos; si causticos es nullptr las cáusticas van también a fotones
+    void trazarFotones(int nPaths, double sigma, uint64_t seed, unsigned hilos, SamplerType muestreo,
+                       std::vector<FotonEmitido>& fotones, std::vector<FotonEmitido>* causticos) const;
+    // Radiancia reflejada en un punto difuso estimada con los k fotones más cercanos del mapa
+    RGB estimacionDensidad(const MapaFotones& mapa, const Point& point, const Direction& normal,
+                           const Material& material, int kFotones, double radio, const Kernel* kernel) const;
 };
 
 class Sphere : public Object3D {
@@ -138,7 +226,11 @@ public:
     Sphere(const Point& base, const float& radius, const Material& material) : 
         Object3D(material), center(base), radius(radius) {}
 
-    std::optional<Intersection> intersect(const Ray& ray) const;
+    std::optional<float> hitDistance(const Ray& ray) const;
+    bool intersectsP(const Ray& ray, float maxT) const;
+    uint64_t hitPacket(const RayPacket& packet, uint64_t active, float* t, uint32_t* element) const;
+    Direction normalAt(const Point& point) const;
+    AABB boundingBox() const;
 
     std::string toString() const;
 };
@@ -152,7 +244,12 @@ public:
     Plane(const Direction& normal, const Material& material, const int distance = 1) :
         Object3D(material), normal(normal.normalize()), distance(distance) {}
 
-    std::optional<Intersection> intersect(const Ray& ray) const;
+    std::optional<float> hitDistance(const Ray& ray) const;
+    bool intersectsP(const Ray& ray, float maxT) const;
+    uint64_t hitPacket(const RayPacket& packet, uint64_t active, float* t, uint32_t* element) const;
+    Direction normalAt(const Point& point) const;
+    AABB boundingBox() const;
+    bool isBounded() const { return false; }
 
     // Returns the distance from the plane to a point
     float distanceTo(const Point& point) const;
@@ -168,7 +265,11 @@ public:
     Triangle(const Point& a, const Point& b, const Point& c, const Material& material) :
         Object3D(material), a(a), b(b), c(c), normal((b - a).cross(c - a).normalize()) {}
 
-    std::optional<Intersection> intersect(const Ray& ray) const;
+    std::optional<float> hitDistance(const Ray& ray) const;
+    bool intersectsP(const Ray& ray, float maxT) const;
+    uint64_t hitPacket(const RayPacket& packet, uint64_t active, float* t, uint32_t* element) const;
+    Direction normalAt(const Point& point) const;
+    AABB boundingBox() const;
 
     std::string toString() const;
 };
@@ -182,7 +283,10 @@ public:
     Cone(const Point& base, const Direction& axis, float radius, float height, const Material& material) :
         Object3D(material), base(base), axis(axis), radius(radius), height(height) {}
 
-    std::optional<Intersection> intersect(const Ray& ray) const;
+    std::optional<float> hitDistance(const Ray& ray) const;
+    bool intersectsP(const Ray& ray, float maxT) const;
+    Direction normalAt(const Point& point) const;
+    AABB boundingBox() const;
 
     std::string toString() const;
 };
@@ -196,9 +300,61 @@ public:
     Cylinder(const Point& base, const Direction& axis, float radius, float height, const Material& material) :
         Object3D(material), base(base), axis(axis.normalize()), radius(radius), height(height) {}
 
-    std::optional<Intersection> intersect(const Ray& ray) const;
+    std::optional<float> hitDistance(const Ray& ray) const;
+    bool intersectsP(const Ray& ray, float maxT) const;
+    Direction normalAt(const Point& point) const;
+    AABB boundingBox() const;
+
+    std::string toString() const;
+};
+
+/**
+ * Indexed triangle mesh. Vertices and indices are stored once for the whole mesh, and the
+ * triangles are repacked per leaf of an internal BVH into blocks of BLOCK_WIDTH with the
+ * first vertex and both edges precomputed in structure-of-arrays layout. Every leaf is a
+ * single block, intersected with one Möller-Trumbore over all its lanes (see simd.hpp:
+ * AVX when the compiler targets it, SSE otherwise, scalar on other architectures).
+ * The element reported by hitElement is the index of the triangle in the input.
+ */
+class TriangleMesh : public Object3D {
+public:
+    static constexpr int BLOCK_WIDTH = 8;
+
+    // positions holds x, y, z of every vertex, indices three vertices per triangle
+    TriangleMesh(const std::vector<float>& positions, std::vector<uint32_t> indices, const Material& material);
+
+    std::optional<float> hitDistance(const Ray& ray) const;
+    std::optional<float> hitElement(const Ray& ray, uint32_t& triangle) const;
+    bool intersectsP(const Ray& ray, float maxT) const;
+    // Throws logic_error: the normal depends on the triangle hit, use normalAtElement
+    // with the elementId reported by hitElement / HitRecord
+    Direction normalAt(const Point& point) const;
+    Direction normalAtElement(const Point& point, uint32_t triangle) const;
+    AABB boundingBox() const;
+
+    size_t vertexCount() const { return vx.size(); }
+    size_t triangleCount() const { return indices.size() / 3; }
+    // Bytes held by the mesh buffers and its hierarchy
+    size_t memoryUsage() const;
 
     std::string toString() const;
+
+private:
+    struct alignas(32) TriangleBlock {
+        float v0x[BLOCK_WIDTH], v0y[BLOCK_WIDTH], v0z[BLOCK_WIDTH];
+        float e1x[BLOCK_WIDTH], e1y[BLOCK_WIDTH], e1z[BLOCK_WIDTH];
+        float e2x[BLOCK_WIDTH], e2y[BLOCK_WIDTH], e2z[BLOCK_WIDTH];
+        uint32_t triangle[BLOCK_WIDTH];     // Unused lanes have null edges and never hit
+    };
+
+    std::vector<float> vx, vy, vz;
+    std::vector<uint32_t> indices;
+    std::vector<TriangleBlock> blocks;
+    std::vector<BVHNode> nodes;             // The offset of a leaf is its block
+    AABB bounds;
+
+    // Closest hit closer than maxT, or the first one found if anyHit
+    std::optional<float> traverse(const Ray& ray, float maxT, bool anyHit, uint32_t& triangle) const;
 };
 
 // Ellipsoid, disk
@@ -234,6 +390,18 @@ inline Scene Scene::fromYAML(const std::string& filename) {
             float nx, ny, nz, d;
             iss >> nx >> ny >> nz >> d;
             scene.addObject(std::make_shared<Plane>(Direction(nx, ny, nz), currentMaterial, (int)d));
+        } else if (keyword == "mesh:") {
+            // Relative paths are taken from the directory of the scene file
+            std::string meshPath;
+            std::getline(iss >> std::ws, meshPath);
+            meshPath.erase(meshPath.find_last_not_of(" \t\r") + 1);
+            std::filesystem::path resolved(meshPath);
+            if (resolved.is_relative()) resolved = std::filesystem::path(filename).parent_path() / resolved;
+            if (auto mesh = loadMesh(resolved.string())) {
+                scene.addObject(std::make_shared<TriangleMesh>(mesh->positions, std::move(mesh->indices), currentMaterial));
+            } else {
+                std::cerr << "Skipping mesh " << meshPath << std::endl;
+            }
         } else if (keyword == "light:") {
             float x, y, z, r, g, b;
             iss >> x >> y >> z >> r >> g >> b;
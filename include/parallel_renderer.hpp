@@ -3,15 +3,19 @@
 #include <thread>
 #include <mutex>
 #include <queue>
+#include <deque>
 #include <condition_variable>
 #include <atomic>
 #include <functional>
 #include <vector>
 #include <memory>
+#include <cstdint>
 
 #include "object3D.hpp"
 #include "Image.hpp"
 #include "render_config.hpp"
+#include "thread_pool.hpp"
+#include "rendering_strategy.hpp"
 
 // Forward declarations
 class Scene;
@@ -24,13 +28,18 @@ enum class RegionType {
     PIXEL,      // Individual pixels
     LINE,       // Horizontal lines  
     COLUMN,     // Vertical columns
-    RECTANGLE   // Rectangular blocks
+    RECTANGLE,  // Rectangular blocks
+    // Rectangular blocks queued along a curve, so that consecutive tiles are neighbours
+    HILBERT,    // Hilbert curve
+    MORTON,     // Z-order curve
+    SPIRAL      // Rings around the centre of the image, centre first
 };
 
 enum class QueueType {
     STD_QUEUE,          // Standard queue with mutex
-    LOCK_FREE_QUEUE,    // Future: lock-free implementation
-    WORK_STEALING       // Future: work-stealing queue
+    LOCK_FREE_QUEUE,    // Bounded lock-free ring buffer
+    WORK_STEALING,      // Per-worker Chase-Lev deques
+    GUIDED              // Mutex queue that splits tiles as it drains
 };
 
 /**
@@ -41,10 +50,30 @@ struct RenderTask {
     int endX, endY;         // Ending coordinates (exclusive)
     int taskId;             // For debugging/profiling
     
-    RenderTask(int sx, int sy, int ex, int ey, int id = 0)
+    RenderTask(int sx = 0, int sy = 0, int ex = 0, int ey = 0, int id = 0)
         : startX(sx), startY(sy), endX(ex), endY(ey), taskId(id) {}
 };
 
+/**
+ * Pixels of one task, rendered apart from the framebuffer so that workers never
+ * write to the same cache lines, then copied into it row by row. Rows start on a
+ * cache line; the buffer keeps its memory between tasks.
+ */
+class TileBuffer {
+public:
+    // Sizes the buffer for task and returns where to render it
+    TileView reset(const RenderTask& task);
+    // Copies the tile into an image of the given width
+    void commit(RGB* pixels, int width) const;
+    const TileView& view() const { return view_; }
+
+private:
+    static constexpr size_t CACHE_LINE = 64;
+    std::vector<RGB> storage_;
+    TileView view_{nullptr, 0, 0, 0};
+    int tileWidth_ = 0, tileHeight_ = 0;
+};
+
 /**
  * Thread-safe task queue interface
  */
@@ -53,8 +82,14 @@ public:
     virtual ~TaskQueue() = default;
     virtual void push(const RenderTask& task) = 0;
     virtual bool pop(RenderTask& task) = 0;
+    // Pop on behalf of a given worker. Queues with per-worker state override it
+    virtual bool pop(RenderTask& task, int workerId) { (void)workerId; return pop(task); }
     virtual bool empty() const = 0;
     virtual size_t size() const = 0;
+    // Signals that no more tasks will be pushed
+    virtual void finish() {}
+    // NUMA node of each worker, for queues that prefer handing work within a node
+    virtual void setWorkerNodes(const std::vector<int>& nodes) { (void)nodes; }
 };
 
 /**
@@ -72,7 +107,105 @@ public:
     bool pop(RenderTask& task) override;
     bool empty() const override;
     size_t size() const override;
-    void finish();
+    void finish() override;
+};
+
+/**
+ * Bounded lock-free MPMC queue (Vyukov's ring buffer).
+ * Every cell carries a sequence number that tells producers and consumers
+ * whether it is free or full, so both ends only need one CAS per operation.
+ * pop never blocks: it returns false as soon as the queue is empty.
+ */
+class LockFreeTaskQueue : public TaskQueue {
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        RenderTask task;
+    };
+
+    std::unique_ptr<Cell[]> buffer_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> enqueuePos_{0};
+    alignas(64) std::atomic<size_t> dequeuePos_{0};
+
+public:
+    explicit LockFreeTaskQueue(size_t capacity);
+
+    void push(const RenderTask& task) override;
+    bool pop(RenderTask& task) override;
+    bool empty() const override;
+    size_t size() const override;
+};
+
+/**
+ * Chase-Lev deque of render tasks with a fixed capacity.
+ * Only the owner calls push and pop (bottom end), any thread may steal (top end).
+ */
+class WorkStealingDeque {
+public:
+    enum class StealResult { SUCCESS, EMPTY, ABORT };
+
+    void reset(size_t capacity);
+    void push(const RenderTask& task);
+    bool pop(RenderTask& task);
+    StealResult steal(RenderTask& task);
+    size_t size() const;
+
+private:
+    alignas(64) std::atomic<int64_t> top_{0};
+    alignas(64) std::atomic<int64_t> bottom_{0};
+    std::vector<RenderTask> buffer_;
+    size_t mask_ = 0;
+};
+
+/**
+ * Work-stealing task queue: one deque per worker.
+ * Tasks pushed before finish() are split into contiguous ranges, one per worker.
+ * Workers drain their own range in order and steal from the others when done.
+ */
+class WorkStealingTaskQueue : public TaskQueue {
+private:
+    std::vector<RenderTask> pending_;
+    std::vector<std::unique_ptr<WorkStealingDeque>> deques_;
+    std::vector<int> nodes_;    // Node of each worker, empty if unknown
+
+    // Tries every victim from firstVictim on, those on the thief's node first
+    bool steal(RenderTask& task, int firstVictim, int thief = -1);
+
+public:
+    explicit WorkStealingTaskQueue(int numWorkers);
+
+    void push(const RenderTask& task) override;
+    bool pop(RenderTask& task) override;
+    bool pop(RenderTask& task, int workerId) override;
+    bool empty() const override;
+    size_t size() const override;
+    void finish() override;
+    void setWorkerNodes(const std::vector<int>& nodes) override { nodes_ = nodes; }
+};
+
+/**
+ * Guided scheduling: workers take tiles in order, but once fewer tiles are left
+ * than workers, a popped tile is halved along its longer side and the other
+ * half goes back to the front of the queue, recursively, until every worker has
+ * something or the tile is down to minSize pixels. Renders can start with large
+ * tiles and still finish on all threads at once. Split halves get new task ids.
+ */
+class GuidedTaskQueue : public TaskQueue {
+private:
+    mutable std::mutex mutex_;
+    std::deque<RenderTask> queue_;
+    int numWorkers_;
+    int minSize_;
+    int nextId_ = 0;
+
+public:
+    explicit GuidedTaskQueue(int numWorkers, int minSize = 4);
+
+    void push(const RenderTask& task) override;
+    bool pop(RenderTask& task) override;
+    bool empty() const override;
+    size_t size() const override;
 };
 
 /**
@@ -88,6 +221,8 @@ private:
     static std::vector<RenderTask> generateLineTasks(int width, int height, int lineSize);
     static std::vector<RenderTask> generateColumnTasks(int width, int height, int columnSize);
     static std::vector<RenderTask> generateRectangleTasks(int width, int height, int blockSize);
+    // Rectangle tasks reordered along the curve of order, with the ids renumbered
+    static std::vector<RenderTask> generateCurveTasks(int width, int height, int blockSize, RegionType order);
 };
 
 /**
@@ -97,6 +232,7 @@ class ParallelRenderer {
 private:
     RenderConfig config_;
     std::unique_ptr<TaskQueue> taskQueue_;
+    ThreadPool* pool_;
     
     // Worker thread function
     void workerThread(const PinholeCamera& camera, const Scene& scene, 
@@ -104,9 +240,11 @@ private:
                      int width, int height, std::atomic<int>& completedTasks);
 
 public:
-    explicit ParallelRenderer(const RenderConfig& config = RenderConfig());
+    // Renders on pool, or on ThreadPool::shared() if it is null
+    explicit ParallelRenderer(const RenderConfig& config = RenderConfig(), ThreadPool* pool = nullptr);
 
-    // Unified render method picks algorithm from config.algorithm
+    // Unified render method picks algorithm from config.algorithm. With
+    // cfg.adaptiveSampling the image comes from AdaptiveSampler, on the same pool
     Image render(const PinholeCamera& camera, const Scene& scene,
                  unsigned samplesPerPixel, const RenderConfig& cfg);
 
@@ -117,16 +255,40 @@ public:
     // Statistics
     struct RenderStats {
         double renderTime;
-        int numTasks;
+        int numTasks;                   // Tasks rendered, splits included
         int numThreads;
         RegionType regionType;
         int regionSize;
+        std::vector<double> idleTime;   // Seconds each worker spent without a task to render
     };
     
     RenderStats getLastRenderStats() const { return lastStats_; }
 
+    // Called from the worker threads each time a task has been copied to the framebuffer,
+    // with the tile and the pixels finished so far. Meant for streaming tiles out and for
+    // progress reports; calls may overlap, so the hook has to be thread-safe
+    using TileHook = std::function<void(const RenderTask& task, const TileView& tile,
+                                        size_t pixelsDone, size_t totalPixels)>;
+    void setTileHook(TileHook hook) { tileHook_ = std::move(hook); }
+
+    struct WorkerStats {
+        int tasksRun = 0;
+        std::vector<double> idleTime;
+    };
+
+    // Runs work on every task with cfg.numThreads workers of pool fed by a queue of
+    // cfg.queueType. Returns once all the tasks are done
+    static WorkerStats forEachTask(const std::vector<RenderTask>& tasks, const RenderConfig& cfg,
+                                   const std::function<void(const RenderTask&)>& work,
+                                   ThreadPool& pool = ThreadPool::shared());
+
+    // Runs work(i) for each of the cfg.numThreads workers, pinned if cfg.pinThreads
+    static void forEachWorker(const RenderConfig& cfg, const std::function<void(int)>& work,
+                              ThreadPool& pool = ThreadPool::shared());
+
 private:
     mutable RenderStats lastStats_;
+    TileHook tileHook_;
     // Generic parallel runner
     Image runParallel(const PinholeCamera& camera, const Scene& scene,
                      unsigned samplesPerPixel,
@@ -138,7 +300,8 @@ private:
  */
 class QueueFactory {
 public:
-    static std::unique_ptr<TaskQueue> createQueue(QueueType type);
+    // capacity is only needed by bounded queues; 0 picks a default
+    static std::unique_ptr<TaskQueue> createQueue(QueueType type, int numWorkers = 1, size_t capacity = 0);
 };
 
 /**
@@ -151,4 +314,12 @@ public:
                                        unsigned samplesPerPixel = 4);
     static RenderConfig findOptimalConfig(const PinholeCamera& camera, const Scene& scene,
                                          unsigned samplesPerPixel = 4);
+    // Contention microbenchmark: every queue type drains PIXEL tasks with no rendering work
+    static void benchmarkQueues(int width, int height, const std::vector<int>& threadCounts,
+                                int repetitions = 3);
+    // Cost of starting and finishing a job: threads created and joined every time vs the pool
+    static void benchmarkThreadPool(int numThreads, int jobs = 1000);
+    // Speedup from 1 thread to every CPU of the machine, with free and pinned workers
+    static void benchmarkScaling(const PinholeCamera& camera, const Scene& scene,
+                                 unsigned samplesPerPixel = 4);
 };
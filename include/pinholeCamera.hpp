@@ -8,6 +8,14 @@
 #include "kernel.hpp"
 #include "object3D.hpp"
 
+// State of a camera path between bounces of the iterative integrator
+struct PathState {
+    Ray ray;
+    RGB radiance;       // Radiance gathered so far
+    RGB throughput;     // Weight applied to everything gathered from now on
+    unsigned depth;
+};
+
 class PinholeCamera {
 public:
  
@@ -32,7 +40,7 @@ public:
     }
     
     Image renderPhotonMapping(const Scene& scene, unsigned samples, 
-                MapaFotones mapa, unsigned kPhotons, double radio, Kernel* kernel) const {
+                const MapaFotones& mapa, unsigned kPhotons, double radio, const Kernel* kernel) const {
         RenderConfig config{RenderingAlgorithm::PHOTON_MAPPING};
         config.photonMap = &mapa;
         config.kPhotons = kPhotons;
@@ -41,6 +49,15 @@ public:
         return render(scene, samples, config);
     }
 
+    // Progressive photon mapping (Knaus y Zwicker, 2011): cada pasada traza pathsPerPass paseos
+    // nuevos, renderiza con sus mapas global y de cáusticas y los libera, así solo hay en memoria
+    // los fotones de una pasada. Los radios de config se reducen en cada pasada según
+    // r(i+1)^2 = r(i)^2 (i + alpha) / (i + 1) y la imagen es la media de todas las pasadas.
+    // kPhotons y kCaustic se ignoran: cada estimación usa todos los fotones a menos de r
+    Image renderProgressivePhotonMapping(const Scene& scene, unsigned samples, unsigned passes,
+                                         int pathsPerPass, const RenderConfig& config,
+                                         double alpha = 2.0 / 3.0) const;
+
     // Accessors
     int getWidth() const { return width; }
     int getHeight() const { return height; }
@@ -48,7 +65,11 @@ public:
     // Public methods for strategies to access
     Ray generateRay(float x, float y) const;
     RGB traceRay(const Ray& ray, const Scene& scene) const;
-    RGB tracePath(const Ray& ray, const Scene& scene, unsigned depth = 0) const;
+    // Direct light of a camera ray whose first hit is already known
+    RGB shadeHit(const Ray& ray, const std::optional<Intersection>& intersection, const Scene& scene) const;
+    RGB tracePath(const Ray& ray, const Scene& scene, Sampler& rng, unsigned depth = 0) const;
+    RGB tracePathIterative(const Ray& ray, const Scene& scene, Sampler& rng,
+                           const RenderConfig& config = RenderConfig{}) const;
 
 private:
     Point origin;
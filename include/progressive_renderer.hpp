@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include "Image.hpp"
+#include "RGB.hpp"
+#include "render_config.hpp"
+
+class Scene;
+class PinholeCamera;
+
+/**
+ * Running sum of the samples of every pixel and how many were taken.
+ * It can be saved and loaded again, so a render can go on where it stopped.
+ */
+struct AccumulationBuffer {
+    int width{0}, height{0};
+    uint64_t seed{0};
+    RenderingAlgorithm algorithm{RenderingAlgorithm::PATH_TRACING};
+    SamplerType sampler{SamplerType::INDEPENDENT};
+    unsigned maxDepth{0}, russianRouletteDepth{0};
+    unsigned samplesPerPass{0};     // Samples each pass adds to a pixel, 0 before the first one
+    unsigned passes{0};             // Passes already added
+    std::vector<RGB> sum;
+    std::vector<uint32_t> counts;
+
+    AccumulationBuffer() = default;
+    AccumulationBuffer(int width, int height, const RenderConfig& config);
+
+    // Mean of the samples of each pixel, black where there is none yet
+    [[nodiscard]] Image image() const;
+
+    // Whether a checkpoint belongs to the same render as config: same image, seed,
+    // algorithm, sample sequence, path depths and samples per pass
+    [[nodiscard]] bool matches(int width, int height, const RenderConfig& config,
+                               unsigned samplesPerPass) const noexcept;
+
+    // Writes to path + ".tmp" and renames it, so a kill while saving keeps the previous checkpoint
+    bool save(const std::string& path) const noexcept;
+    [[nodiscard]] static std::optional<AccumulationBuffer> load(const std::string& path);
+};
+
+/**
+ * Progressive rendering: each pass adds samplesPerPass samples to every pixel
+ * of the accumulation buffer. After a pass the current mean can be written as a
+ * preview and the buffer checkpointed. Pass i always takes the samples
+ * [i * samplesPerPass, (i + 1) * samplesPerPass) of each pixel, so a render
+ * resumed from a checkpoint gives the same image as one that never stopped.
+ */
+class ProgressiveRenderer {
+public:
+    struct Settings {
+        unsigned samplesPerPass = 1;
+        unsigned passes = 16;           // Total passes, counting those in the checkpoint
+        std::string previewPath;        // PPM rewritten after every pass, if set
+        std::string checkpointPath;     // Loaded if it exists and saved after every pass, if set
+    };
+
+    ProgressiveRenderer(const PinholeCamera& camera, const Scene& scene, const RenderConfig& config);
+
+    // Renders until settings.passes passes have been accumulated and returns the mean
+    Image render(const Settings& settings);
+
+    // Adds one pass to the buffer
+    void renderPass(unsigned samplesPerPass);
+
+    const AccumulationBuffer& buffer() const { return buffer_; }
+
+private:
+    const PinholeCamera& camera_;
+    const Scene& scene_;
+    RenderConfig config_;
+    AccumulationBuffer buffer_;
+};
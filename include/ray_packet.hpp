@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+
+#include "object3D.hpp"
+
+/**
+ * Up to MAX_RAYS rays in structure-of-arrays layout, traced together through the
+ * BVH until their first hit. Bit i of the masks used with a packet is ray i.
+ * The arrays are sized for a whole packet so that SIMD loads never run past them.
+ */
+struct RayPacket {
+    static constexpr int MAX_RAYS = 64;
+
+    int count;
+    const Ray* rays;    // The rays themselves, for primitives without a packet kernel
+    alignas(32) float ox[MAX_RAYS], oy[MAX_RAYS], oz[MAX_RAYS];
+    alignas(32) float dx[MAX_RAYS], dy[MAX_RAYS], dz[MAX_RAYS];
+    alignas(32) float invDx[MAX_RAYS], invDy[MAX_RAYS], invDz[MAX_RAYS];
+
+    RayPacket(const Ray* rays, int count);
+
+    uint64_t all() const { return count == MAX_RAYS ? ~uint64_t(0) : (uint64_t(1) << count) - 1; }
+};
+
+/**
+ * Closest hit of every ray of a packet. A ray without a hit keeps maxDistance.
+ */
+struct PacketHits {
+    alignas(32) float distance[RayPacket::MAX_RAYS];
+    uint32_t primitiveId[RayPacket::MAX_RAYS];
+    uint32_t materialId[RayPacket::MAX_RAYS];
+    uint32_t elementId[RayPacket::MAX_RAYS];
+    uint64_t found = 0;
+
+    explicit PacketHits(float maxDistance) {
+        for (float& d : distance) d = maxDistance;
+    }
+
+    // Keeps the hit if it is the closest one of the ray so far. Ties go to the lowest
+    // primitive, like in BVH::intersect
+    void record(int ray, float t, uint32_t primitive, uint32_t material, uint32_t element) {
+        bool tie = (found >> ray & 1) && t == distance[ray] && primitive < primitiveId[ray];
+        if (t < distance[ray] || tie) {
+            distance[ray] = t;
+            primitiveId[ray] = primitive;
+            materialId[ray] = material;
+            elementId[ray] = element;
+            found |= uint64_t(1) << ray;
+        }
+    }
+
+    std::optional<HitRecord> hit(int ray) const {
+        if (!(found >> ray & 1)) return std::nullopt;
+        return HitRecord{distance[ray], primitiveId[ray], materialId[ray], elementId[ray]};
+    }
+};
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <cstdint>
+#include <string>
 #include "foton.hpp"
+#include "kernel.hpp"
+#include "sampler.hpp"
 
 // Forward declarations
-class Kernel;
 enum class RegionType;
 enum class QueueType;
 
@@ -27,12 +30,45 @@ struct RenderConfig {
     int regionSize = 8;
     int numThreads = 4;
     QueueType queueType;
+    // Pins each worker to a CPU of CpuTopology::system(), spread evenly over the NUMA
+    // nodes. With QueueType::WORK_STEALING workers also first-touch the part of the
+    // framebuffer they start with and steal from their own node first; the other
+    // queues hand tiles out in no fixed order, so they only get the pinning
+    bool pinThreads = false;
+
+    // Side of the packets of camera rays traced together up to their first hit
+    // (4 or 8, at most 8). 0 traces every camera ray on its own
+    unsigned packetSize = 0;
+
+    // Seed of the per-sample random generators: same seed, same image
+    uint64_t seed = 0;
+    // Sequence behind jitter, BSDF and light sampling. The Sobol ones reach the same
+    // error with fewer samples per pixel
+    SamplerType sampler = SamplerType::INDEPENDENT;
+    
+    // Path tracing: bounces after which paths are cut, and after which Russian roulette starts
+    unsigned maxDepth = 20;
+    unsigned russianRouletteDepth = 3;
     
     // Photon mapping specific parameters
-    MapaFotones* photonMap = nullptr;
-    unsigned kPhotons = 50;
+    const MapaFotones* photonMap = nullptr;    // Shared by every thread, only read while rendering
+    unsigned kPhotons = 50;                     // 0: every photon within radius, normalised by pi r^2
     double radius = 0.1;
-    Kernel* kernel = nullptr;
+    const Kernel* kernel = nullptr;
+
+    // Optional caustic map, estimated on its own with a smaller radius and k
+    const MapaFotones* causticMap = nullptr;
+    unsigned kCaustic = 20;
+    double causticRadius = 0.05;
+
+    // Adaptive sampling: samplesPerPixel becomes the average budget. Each pixel takes
+    // adaptiveMinSamples samples and stops once the 95% confidence interval of its
+    // luminance is within adaptiveError of the mean; the rest goes to the noisy ones.
+    // Honoured by PinholeCamera::render and ParallelRenderer::render
+    bool adaptiveSampling = false;
+    unsigned adaptiveMinSamples = 4;
+    double adaptiveError = 0.05;
+    std::string heatmapPath;    // If set, the samples per pixel are written there as a PPM
     
     // Constructors for convenience
     RenderConfig();
@@ -43,7 +79,7 @@ struct RenderConfig {
         : algorithm(alg), mode(mode) { initDefaults(); }
     
     // Photon mapping constructor
-    RenderConfig(MapaFotones* pMap, unsigned k, double r, Kernel* kern)
+    RenderConfig(const MapaFotones* pMap, unsigned k, double r, const Kernel* kern)
         : algorithm(RenderingAlgorithm::PHOTON_MAPPING), photonMap(pMap), 
           kPhotons(k), radius(r), kernel(kern) { initDefaults(); }
 
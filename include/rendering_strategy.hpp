@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 #include "render_config.hpp"
 #include "RGB.hpp"
 
@@ -8,6 +9,18 @@
 class PinholeCamera;
 class Scene;
 
+// Where a strategy writes the pixels of a tile: pixel (x, y) of the image is
+// data[(y - startY) * stride + (x - startX)]. Either the whole image or a tile buffer
+struct TileView {
+    RGB* data;
+    int startX, startY;
+    int stride;
+
+    RGB& at(int x, int y) const { return data[size_t(y - startY) * stride + (x - startX)]; }
+
+    static TileView wholeImage(std::vector<RGB>& pixels, int width) { return {pixels.data(), 0, 0, width}; }
+};
+
 class RenderingStrategy {
 public:
     virtual ~RenderingStrategy() = default;
@@ -15,13 +28,33 @@ public:
     virtual RGB calculatePixelColor(const PinholeCamera& camera, const Scene& scene, 
                                    float x, float y, unsigned samples, 
                                    const RenderConfig& config) const = 0;
+
+    // Color of sample number 'sample' of pixel (x, y), the same one calculatePixelColor
+    // averages. Lets callers decide how many samples each pixel takes
+    virtual RGB sampleColor(const PinholeCamera& camera, const Scene& scene,
+                            float x, float y, unsigned sample,
+                            const RenderConfig& config) const = 0;
+
+    // Colors the pixels [startX, endX) x [startY, endY) of the camera image into pixels.
+    // By default pixel by pixel with calculatePixelColor
+    virtual void calculateTileColors(const PinholeCamera& camera, const Scene& scene,
+                                     int startX, int startY, int endX, int endY, unsigned samples,
+                                     const RenderConfig& config, const TileView& pixels) const;
 };
 
+// Strategies that only need the first hit of a camera ray to shade it trace the
+// camera rays in packets when config.packetSize is set
 class RayTracingStrategy : public RenderingStrategy {
 public:
     RGB calculatePixelColor(const PinholeCamera& camera, const Scene& scene, 
                            float x, float y, unsigned samples, 
                            const RenderConfig& config) const override;
+    RGB sampleColor(const PinholeCamera& camera, const Scene& scene,
+                    float x, float y, unsigned sample,
+                    const RenderConfig& config) const override;
+    void calculateTileColors(const PinholeCamera& camera, const Scene& scene,
+                             int startX, int startY, int endX, int endY, unsigned samples,
+                             const RenderConfig& config, const TileView& pixels) const override;
 };
 
 class PathTracingStrategy : public RenderingStrategy {
@@ -29,6 +62,9 @@ public:
     RGB calculatePixelColor(const PinholeCamera& camera, const Scene& scene, 
                            float x, float y, unsigned samples, 
                            const RenderConfig& config) const override;
+    RGB sampleColor(const PinholeCamera& camera, const Scene& scene,
+                    float x, float y, unsigned sample,
+                    const RenderConfig& config) const override;
 };
 
 class PhotonMappingStrategy : public RenderingStrategy {
@@ -36,6 +72,12 @@ public:
     RGB calculatePixelColor(const PinholeCamera& camera, const Scene& scene, 
                            float x, float y, unsigned samples, 
                            const RenderConfig& config) const override;
+    RGB sampleColor(const PinholeCamera& camera, const Scene& scene,
+                    float x, float y, unsigned sample,
+                    const RenderConfig& config) const override;
+    void calculateTileColors(const PinholeCamera& camera, const Scene& scene,
+                             int startX, int startY, int endX, int endY, unsigned samples,
+                             const RenderConfig& config, const TileView& pixels) const override;
 };
 
 class StrategyFactory {
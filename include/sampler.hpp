@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include "geometry.hpp"
+#include "utils.hpp"
+
+enum class SamplerType {
+    INDEPENDENT,    // PCG32 uniform randoms
+    SOBOL,          // Sobol with random digit (XOR) scrambling
+    OWEN_SOBOL      // Sobol with nested uniform (Owen) scrambling
+};
+
+/*
+ *  Source of the random numbers of one sample: camera jitter, BSDF choices and
+ *  directions, Russian roulette and light emission all draw from it in order.
+ *
+ *  The Sobol samplers follow Burley, "Practical Hash-based Owen Scrambling"
+ *  (JCGT 2020): dimensions are taken in pairs, each pair is the 2D Sobol
+ *  sequence with its index shuffled by a hash of the pair, and every value is
+ *  scrambled with a hash of its dimension. The first 2^m samples of a pixel
+ *  are then stratified in every pair of dimensions. next2D always starts a new
+ *  pair so that 2D decisions (jitter, directions) get that stratification.
+ *
+ *  INDEPENDENT draws exactly the same numbers as the PCG32 generators it replaces.
+ */
+class Sampler {
+public:
+    // Sample 'index' of the sequence with the given scramble seed. The PCG32 stream
+    // (seed, stream) is only used by INDEPENDENT
+    Sampler(SamplerType type, uint64_t seed, uint64_t stream, uint32_t index)
+        : type(type), rng(seed, stream), scramble(PCG32::mix(seed ^ stream * 0x9e3779b97f4a7c15ULL)),
+          index(index) {}
+
+    // Sampler of one camera sample, like PCG32::forSample
+    static Sampler forSample(SamplerType type, uint64_t renderSeed, float x, float y, uint64_t sample) {
+        Sampler sampler(type, 0, 0, uint32_t(sample));
+        sampler.rng = PCG32::forSample(renderSeed, x, y, sample);
+        sampler.scramble = PCG32::mix(renderSeed ^ PCG32::mix(PCG32::pixelKey(x, y)));
+        return sampler;
+    }
+
+    // Uniform in [0, 1)
+    double next1D() {
+        if (type == SamplerType::INDEPENDENT) return rng.next0_1();
+        return sobol(dimension++);
+    }
+
+    void next2D(double& u, double& v) {
+        if (type == SamplerType::INDEPENDENT) {
+            u = rng.next0_1();
+            v = rng.next0_1();
+            return;
+        }
+        dimension += dimension & 1;
+        u = sobol(dimension);
+        v = sobol(dimension + 1);
+        dimension += 2;
+    }
+
+    SamplerType getType() const { return type; }
+
+private:
+    SamplerType type;
+    PCG32 rng;
+    uint64_t scramble;
+    uint32_t index;
+    uint32_t dimension = 0;
+
+    double sobol(uint32_t dimension) const;
+};
+
+inline double rand0_1(Sampler& sampler) {
+    return sampler.next1D();
+}
+
+//https:projecteuclid.org/journals/annals-of-mathematical-statistics/volume-43/issue-2/Choosing-a-Point-from-the-Surface-of-a-Sphere/10.1214/aoms/1177692644.full
+
+/*
+ *  Este código implementa una función para muestrear direcciones aleatorias uniformemente distribuidas sobre la superficie de una esfera
+ */
+
+inline Direction muestraAleatoriaUniforme(Sampler& sampler) {
+    // Genera dos números aleatorios uniformes en [0, 1)
+    double u, v;
+    sampler.next2D(u, v);
+
+    // Calcula los ángulos esféricos
+    double theta = acos(2.0 * u - 1.0);      // Ángulo polar
+    double phi = 2.0 * M_PI * v;             // Ángulo azimutal
+
+    // Convierte a coordenadas cartesianas
+    double x = sin(theta) * cos(phi);
+    double y = sin(theta) * sin(phi);
+    double z = cos(theta);
+
+    return Direction(x, y, z);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cmath>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/*
+ *  Thin wrapper over the widest float vector the compiler targets: AVX (8 lanes),
+ *  SSE (4 lanes) or plain floats (1 lane). Kernels written against it loop over
+ *  their data in steps of simd::WIDTH and work unchanged on every target.
+ *  V holds WIDTH floats, M the result of a comparison.
+ */
+
+#if defined(__GNUC__)
+#define SIMD_INLINE inline __attribute__((always_inline))
+#else
+#define SIMD_INLINE inline
+#endif
+
+namespace simd {
+
+#if defined(__AVX__)
+    constexpr int WIDTH = 8;
+    using V = __m256;
+    using M = __m256;
+
+    SIMD_INLINE V set1(float a) { return _mm256_set1_ps(a); }
+    SIMD_INLINE V load(const float* p) { return _mm256_load_ps(p); }
+    SIMD_INLINE void store(float* p, V a) { _mm256_store_ps(p, a); }
+    SIMD_INLINE V add(V a, V b) { return _mm256_add_ps(a, b); }
+    SIMD_INLINE V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+    SIMD_INLINE V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+    SIMD_INLINE V div(V a, V b) { return _mm256_div_ps(a, b); }
+    SIMD_INLINE V sqrt(V a) { return _mm256_sqrt_ps(a); }
+    SIMD_INLINE V min(V a, V b) { return _mm256_min_ps(a, b); }
+    SIMD_INLINE V max(V a, V b) { return _mm256_max_ps(a, b); }
+    SIMD_INLINE V abs(V a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    SIMD_INLINE M lt(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    SIMD_INLINE M le(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    SIMD_INLINE M gt(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    SIMD_INLINE M ge(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    SIMD_INLINE M both(M a, M b) { return _mm256_and_ps(a, b); }
+    // a where the mask is set, b elsewhere
+    SIMD_INLINE V select(M m, V a, V b) { return _mm256_blendv_ps(b, a, m); }
+    SIMD_INLINE unsigned bits(M m) { return unsigned(_mm256_movemask_ps(m)); }
+#elif defined(__SSE2__)
+    constexpr int WIDTH = 4;
+    using V = __m128;
+    using M = __m128;
+
+    SIMD_INLINE V set1(float a) { return _mm_set1_ps(a); }
+    SIMD_INLINE V load(const float* p) { return _mm_load_ps(p); }
+    SIMD_INLINE void store(float* p, V a) { _mm_store_ps(p, a); }
+    SIMD_INLINE V add(V a, V b) { return _mm_add_ps(a, b); }
+    SIMD_INLINE V sub(V a, V b) { return _mm_sub_ps(a, b); }
+    SIMD_INLINE V mul(V a, V b) { return _mm_mul_ps(a, b); }
+    SIMD_INLINE V div(V a, V b) { return _mm_div_ps(a, b); }
+    SIMD_INLINE V sqrt(V a) { return _mm_sqrt_ps(a); }
+    SIMD_INLINE V min(V a, V b) { return _mm_min_ps(a, b); }
+    SIMD_INLINE V max(V a, V b) { return _mm_max_ps(a, b); }
+    SIMD_INLINE V abs(V a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    SIMD_INLINE M lt(V a, V b) { return _mm_cmplt_ps(a, b); }
+    SIMD_INLINE M le(V a, V b) { return _mm_cmple_ps(a, b); }
+    SIMD_INLINE M gt(V a, V b) { return _mm_cmpgt_ps(a, b); }
+    SIMD_INLINE M ge(V a, V b) { return _mm_cmpge_ps(a, b); }
+    SIMD_INLINE M both(M a, M b) { return _mm_and_ps(a, b); }
+    SIMD_INLINE V select(M m, V a, V b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+    SIMD_INLINE unsigned bits(M m) { return unsigned(_mm_movemask_ps(m)); }
+#else
+    constexpr int WIDTH = 1;
+    using V = float;
+    using M = bool;
+
+    SIMD_INLINE V set1(float a) { return a; }
+    SIMD_INLINE V load(const float* p) { return *p; }
+    SIMD_INLINE void store(float* p, V a) { *p = a; }
+    SIMD_INLINE V add(V a, V b) { return a + b; }
+    SIMD_INLINE V sub(V a, V b) { return a - b; }
+    SIMD_INLINE V mul(V a, V b) { return a * b; }
+    SIMD_INLINE V div(V a, V b) { return a / b; }
+    SIMD_INLINE V sqrt(V a) { return std::sqrt(a); }
+    SIMD_INLINE V min(V a, V b) { return a < b ? a : b; }
+    SIMD_INLINE V max(V a, V b) { return a > b ? a : b; }
+    SIMD_INLINE V abs(V a) { return std::abs(a); }
+    SIMD_INLINE M lt(V a, V b) { return a < b; }
+    SIMD_INLINE M le(V a, V b) { return a <= b; }
+    SIMD_INLINE M gt(V a, V b) { return a > b; }
+    SIMD_INLINE M ge(V a, V b) { return a >= b; }
+    SIMD_INLINE M both(M a, M b) { return a && b; }
+    SIMD_INLINE V select(M m, V a, V b) { return m ? a : b; }
+    SIMD_INLINE unsigned bits(M m) { return m ? 1u : 0u; }
+#endif
+
+    // Dot product of two vectors given by their components, in the same order as Direction::dot
+    SIMD_INLINE V dot(V ax, V ay, V az, V bx, V by, V bz) {
+        return add(add(mul(ax, bx), mul(ay, by)), mul(az, bz));
+    }
+}
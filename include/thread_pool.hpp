@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Long-lived worker threads that sleep until a job is submitted.
+ * A job runs a function once for each worker index in [0, parallelism);
+ * the indices are handed out to whichever threads are free, and the thread
+ * that waits for a job also runs its pending indices, so a render never
+ * pays for creating or joining threads.
+ */
+class ThreadPool {
+public:
+    struct Job;
+    using JobHandle = std::shared_ptr<Job>;
+
+    explicit ThreadPool(int numThreads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Queues work(i) for every i in [0, parallelism) and returns at once.
+    // The pool grows to parallelism - 1 threads if it has fewer
+    JobHandle submit(int parallelism, std::function<void(int)> work);
+    // Runs the indices of job nobody has taken yet, then blocks until the rest finish.
+    // Rethrows the first exception thrown by any index of the job
+    void wait(const JobHandle& job);
+    // submit and wait
+    void run(int parallelism, std::function<void(int)> work) { wait(submit(parallelism, std::move(work))); }
+
+    int size() const;
+
+    // Pool shared by every renderer of the process, started on first use
+    static ThreadPool& shared();
+
+private:
+    mutable std::mutex mutex_;
+    std::condition_variable wakeUp_;
+    std::deque<JobHandle> pending_;      // Jobs with indices not taken yet
+    std::vector<std::thread> threads_;
+    bool stopping_ = false;
+
+    void grow(int numThreads);
+    void workerLoop();
+    // Takes the next index of the first pending job, or of job if given. Needs mutex_
+    bool claim(const JobHandle& only, JobHandle& job, int& index);
+    static void execute(const JobHandle& job, int index);
+};
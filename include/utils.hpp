@@ -1,38 +1,69 @@
 #pragma once
 
-#include <random>
 #include <cmath>
-#include <cstdlib>
+#include <cstdint>
+#include <cstring>
 #include "geometry.hpp"
 
-//https:projecteuclid.org/journals/annals-of-mathematical-statistics/volume-43/issue-2/Choosing-a-Point-from-the-Surface-of-a-Sphere/10.1214/aoms/1177692644.full
+/*
+ *  PCG32 random number generator (https://www.pcg-random.org/).
+ *  Small enough to live on the stack of every render thread, so threads never share
+ *  state. Renders seed one generator per pixel sample (see PCG32::forSample), which
+ *  makes the result independent of how pixels are distributed among threads.
+ */
+class PCG32 {
+public:
+    explicit PCG32(uint64_t seed = 0x853c49e6748fea9bULL, uint64_t stream = 0xda3e39cb94b95bdbULL) {
+        reseed(seed, stream);
+    }
 
-namespace {
-    static std::mt19937 rng(std::random_device{}());
-    static std::uniform_real_distribution<double> dist01(0.0, 1.0);
-}
+    void reseed(uint64_t seed, uint64_t stream) {
+        state = 0u;
+        inc = (stream << 1u) | 1u;
+        nextUInt();
+        state += seed;
+        nextUInt();
+    }
 
-inline double rand0_1() {
-    return dist01(rng);
-}
+    uint32_t nextUInt() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + inc;
+        uint32_t xorshifted = uint32_t(((old >> 18u) ^ old) >> 27u);
+        uint32_t rot = uint32_t(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+    }
 
-/* 
- *  Este código implementa una función para muestrear direcciones aleatorias uniformemente distribuidas sobre la superficie de una esfera
- */
+    // Uniform double in [0, 1)
+    double next0_1() {
+        return nextUInt() * 0x1p-32;
+    }
+
+    // Generator for one camera sample, identified by the render seed, the pixel
+    // coordinates handed to the strategies and the sample index
+    static PCG32 forSample(uint64_t renderSeed, float x, float y, uint64_t sample) {
+        return PCG32(mix(renderSeed ^ mix(pixelKey(x, y))), mix(sample + 0x9e3779b97f4a7c15ULL * renderSeed));
+    }
 
-inline Direction muestraAleatoriaUniforme() {
-    // Genera dos números aleatorios uniformes en [0, 1)
-    double u = rand0_1();
-    double v = rand0_1();
+    // Bits of the pixel coordinates as one key
+    static uint64_t pixelKey(float x, float y) {
+        uint32_t xb, yb;
+        std::memcpy(&xb, &x, sizeof(float));
+        std::memcpy(&yb, &y, sizeof(float));
+        return (uint64_t(xb) << 32) | yb;
+    }
 
-    // Calcula los ángulos esféricos
-    double theta = acos(2.0 * u - 1.0);      // Ángulo polar
-    double phi = 2.0 * M_PI * v;             // Ángulo azimutal
+    // SplitMix64 finaliser, spreads correlated keys over the whole 64-bit range
+    static uint64_t mix(uint64_t z) {
+        z += 0x9e3779b97f4a7c15ULL;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
 
-    // Convierte a coordenadas cartesianas
-    double x = sin(theta) * cos(phi);
-    double y = sin(theta) * sin(phi);
-    double z = cos(theta);
+private:
+    uint64_t state, inc;
+};
 
-    return Direction(x, y, z);
-}
\ No newline at end of file
+inline double rand0_1(PCG32& rng) {
+    return rng.next0_1();
+}
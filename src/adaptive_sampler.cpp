@@ -0,0 +1,150 @@
+#include "../include/adaptive_sampler.hpp"
+#include "../include/parallel_renderer.hpp"
+#include "../include/pinholeCamera.hpp"
+#include "../include/rendering_strategy.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // No pixel takes more than this many times the average budget
+    constexpr unsigned MAX_SAMPLES_FACTOR = 8;
+    // Below this luminance the target error is absolute instead of relative
+    constexpr double MIN_LUMINANCE = 1e-3;
+
+    double luminanceOf(const RGB& c) {
+        return 0.2126 * c.r + 0.7152 * c.g + 0.0722 * c.b;
+    }
+}
+
+/**************
+ * PixelStats *
+ **************/
+
+void PixelStats::add(const RGB& sample) {
+    count++;
+    double n = count;
+    r += (sample.r - r) / n;
+    g += (sample.g - g) / n;
+    b += (sample.b - b) / n;
+
+    double l = luminanceOf(sample);
+    double delta = l - luminance;
+    luminance += delta / n;
+    m2 += delta * (l - luminance);
+}
+
+double PixelStats::errorBound() const {
+    return count > 0 ? 1.96 * std::sqrt(variance() / count) : 0.0;
+}
+
+bool PixelStats::converged(double relativeError) const {
+    return count > 1 && errorBound() <= relativeError * std::max(luminance, MIN_LUMINANCE);
+}
+
+/*******************
+ * AdaptiveSampler *
+ *******************/
+
+AdaptiveSampler::Result AdaptiveSampler::render(const PinholeCamera& camera, const Scene& scene,
+                                                unsigned samplesPerPixel, const RenderConfig& config,
+                                                ThreadPool* pool) {
+    const int width = camera.getWidth(), height = camera.getHeight();
+    const size_t numPixels = size_t(width) * height;
+    const size_t budget = numPixels * samplesPerPixel;
+    const unsigned maxSamples = std::max(samplesPerPixel * MAX_SAMPLES_FACTOR, 1u);
+
+    auto strategy = StrategyFactory::createStrategy(config.algorithm);
+    auto tasks = TaskGenerator::generateTasks(width, height, config);
+
+    std::vector<PixelStats> stats(numPixels);
+    std::vector<char> active(numPixels, 1);
+
+    // Takes 'batch' more samples in every active pixel of the task
+    auto sampleTask = [&](const RenderTask& task, unsigned batch) {
+        for (int y = task.startY; y < task.endY; ++y) {
+            float ny = float(y) - (height / 2.0f);
+            for (int x = task.startX; x < task.endX; ++x) {
+                size_t p = size_t(y) * width + x;
+                if (!active[p]) continue;
+                float nx = float(x) - (width / 2.0f);
+                PixelStats& s = stats[p];
+                unsigned end = std::min(s.count + batch, maxSamples);
+                for (unsigned i = s.count; i < end; i++) {
+                    s.add(strategy->sampleColor(camera, scene, nx, ny, i, config));
+                }
+            }
+        }
+    };
+
+    auto runRound = [&](const std::vector<RenderTask>& round, unsigned batch) {
+        if (config.mode == RenderingMode::PARALLEL) {
+            ParallelRenderer::forEachTask(round, config,
+                [&](const RenderTask& task) { sampleTask(task, batch); },
+                pool ? *pool : ThreadPool::shared());
+        } else {
+            for (const auto& task : round) sampleTask(task, batch);
+        }
+    };
+
+    unsigned batch = std::clamp(config.adaptiveMinSamples, 1u, std::max(samplesPerPixel, 1u));
+    size_t used = 0;
+    std::vector<RenderTask> round = tasks;
+
+    while (!round.empty() && batch > 0) {
+        runRound(round, batch);
+
+        // Pixels and tiles left for the next round
+        size_t numActive = 0;
+        used = 0;
+        for (size_t p = 0; p < numPixels; p++) {
+            used += stats[p].count;
+            if (active[p] && (stats[p].count >= maxSamples || stats[p].converged(config.adaptiveError))) {
+                active[p] = 0;
+            }
+            numActive += active[p];
+        }
+        if (numActive == 0 || used >= budget) break;
+
+        round.clear();
+        for (const auto& task : tasks) {
+            bool pending = false;
+            for (int y = task.startY; y < task.endY && !pending; ++y) {
+                for (int x = task.startX; x < task.endX && !pending; ++x) {
+                    pending = active[size_t(y) * width + x];
+                }
+            }
+            if (pending) round.push_back(task);
+        }
+
+        // The remaining budget is shared between the pixels still sampling, at most
+        // doubling their count so that they can converge before taking all of it
+        size_t share = (budget - used) / numActive;
+        batch = unsigned(std::min<size_t>(share, batch * 2));
+    }
+
+    Result result;
+    result.samples.resize(numPixels);
+    std::vector<RGB> pixels(numPixels);
+    for (size_t p = 0; p < numPixels; p++) {
+        pixels[p] = stats[p].mean();
+        result.samples[p] = stats[p].count;
+    }
+    result.image = Image(width, height, std::move(pixels));
+    result.heatmap = heatmap(result.samples, width, height);
+    return result;
+}
+
+Image AdaptiveSampler::heatmap(const std::vector<unsigned>& samples, int width, int height) {
+    unsigned most = 1;
+    for (unsigned s : samples) most = std::max(most, s);
+
+    std::vector<RGB> pixels(samples.size());
+    for (size_t p = 0; p < samples.size(); p++) {
+        float t = float(samples[p]) / most;
+        pixels[p] = RGB(std::clamp(3.0f * t, 0.0f, 1.0f),
+                        std::clamp(3.0f * t - 1.0f, 0.0f, 1.0f),
+                        std::clamp(3.0f * t - 2.0f, 0.0f, 1.0f));
+    }
+    return Image(width, height, std::move(pixels));
+}
@@ -0,0 +1,332 @@
+#include "../include/bvh.hpp"
+#include "../include/object3D.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+using namespace std;
+
+namespace {
+    constexpr float INF = numeric_limits<float>::infinity();
+    // Boxes are slightly inflated so that hits lying exactly on a face are not culled
+    constexpr float BOX_PADDING = 1e-4f;
+}
+
+/********
+ * AABB *
+ ********/
+
+AABB::AABB() : min(INF, INF, INF), max(-INF, -INF, -INF) {}
+
+void AABB::expand(const Point& p) {
+    min = Point(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+    max = Point(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+}
+
+void AABB::expand(const AABB& box) {
+    // Corner by corner, so an empty box (min = +inf, max = -inf) leaves this one as it is
+    min = Point(std::min(min.x, box.min.x), std::min(min.y, box.min.y), std::min(min.z, box.min.z));
+    max = Point(std::max(max.x, box.max.x), std::max(max.y, box.max.y), std::max(max.z, box.max.z));
+}
+
+Point AABB::centroid() const {
+    return Point((min.x + max.x) * 0.5f, (min.y + max.y) * 0.5f, (min.z + max.z) * 0.5f);
+}
+
+float AABB::surfaceArea() const {
+    float dx = max.x - min.x, dy = max.y - min.y, dz = max.z - min.z;
+    if (dx < 0 || dy < 0 || dz < 0) return 0.0f;
+    return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+bool AABB::isInfinite() const {
+    for (int i = 0; i < 3; i++) {
+        if (std::isinf(min[i]) || std::isinf(max[i])) return true;
+    }
+    return false;
+}
+
+AABB AABB::infinite() {
+    return AABB(Point(-INF, -INF, -INF), Point(INF, INF, INF));
+}
+
+/**********
+ * BoxRay *
+ **********/
+
+BoxRay::BoxRay(const Point& o, const Direction& d) {
+    const float dir[3] = {d.x, d.y, d.z};
+    for (int k = 0; k < 3; k++) {
+        origin[k] = o[k];
+        invDir[k] = 1.0f / dir[k];
+        negative[k] = invDir[k] < 0;
+    }
+}
+
+namespace {
+    constexpr int SAH_BINS = 12;
+    // Past this depth nodes are split at the median: 2^32 primitives need at most 32 more
+    // levels, and a traversal needs one stack entry per level plus one
+    constexpr int SAH_MAX_DEPTH = BVH_STACK_SIZE / 2;
+
+    struct BuildEntry {
+        AABB bounds;
+        Point centroid;
+        uint32_t index;
+    };
+
+    struct SAHBuilder {
+        std::vector<BuildEntry> entries;
+        std::vector<BVHNode>& nodes;
+        int maxLeafSize, leafWidth;
+
+        // Relative cost of intersecting count primitives leafWidth at a time
+        float leafCost(size_t count, float area) const {
+            return float((count + leafWidth - 1) / leafWidth) * area;
+        }
+
+        void build(size_t begin, size_t end, int depth);
+    };
+
+    void SAHBuilder::build(size_t begin, size_t end, int depth) {
+        assert(depth < BVH_STACK_SIZE);
+        size_t nodeIndex = nodes.size();
+        nodes.emplace_back();
+
+        AABB bounds, centroidBounds;
+        for (size_t i = begin; i < end; i++) {
+            bounds.expand(entries[i].bounds);
+            centroidBounds.expand(entries[i].centroid);
+        }
+        for (int k = 0; k < 3; k++) {
+            nodes[nodeIndex].bmin[k] = bounds.min[k] - BOX_PADDING;
+            nodes[nodeIndex].bmax[k] = bounds.max[k] + BOX_PADDING;
+        }
+
+        size_t count = end - begin;
+        auto makeLeaf = [&]() {
+            nodes[nodeIndex].offset = uint32_t(begin);
+            nodes[nodeIndex].count = uint16_t(count);
+            nodes[nodeIndex].axis = 0;
+        };
+
+        if (count <= 2) {
+            makeLeaf();
+            return;
+        }
+
+        // Binned SAH: evaluate SAH_BINS - 1 candidate planes along every axis
+        int bestAxis = -1, bestSplit = -1;
+        float bestCost = INF;
+        for (int axis = 0; axis < 3; axis++) {
+            float cmin = centroidBounds.min[axis], cmax = centroidBounds.max[axis];
+            if (cmax - cmin <= 0.0f) continue;
+            // Extents too small to divide into bins are treated like coincident centroids
+            float scale = SAH_BINS / (cmax - cmin);
+            if (!std::isfinite(scale)) continue;
+
+            AABB binBounds[SAH_BINS];
+            int binCount[SAH_BINS] = {0};
+            for (size_t i = begin; i < end; i++) {
+                int b = std::min(SAH_BINS - 1, int((entries[i].centroid[axis] - cmin) * scale));
+                binCount[b]++;
+                binBounds[b].expand(entries[i].bounds);
+            }
+
+            // Sweep from the right to get the area and count of every right side
+            float rightArea[SAH_BINS];
+            int rightCount[SAH_BINS];
+            AABB accum;
+            int accumCount = 0;
+            for (int b = SAH_BINS - 1; b > 0; b--) {
+                accum.expand(binBounds[b]);
+                accumCount += binCount[b];
+                rightArea[b] = accum.surfaceArea();
+                rightCount[b] = accumCount;
+            }
+
+            accum = AABB();
+            accumCount = 0;
+            for (int b = 0; b < SAH_BINS - 1; b++) {
+                accum.expand(binBounds[b]);
+                accumCount += binCount[b];
+                if (accumCount == 0 || rightCount[b + 1] == 0) continue;
+                float cost = leafCost(accumCount, accum.surfaceArea()) + leafCost(rightCount[b + 1], rightArea[b + 1]);
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = b;
+                }
+            }
+        }
+
+        size_t mid;
+        if (depth >= SAH_MAX_DEPTH) {
+            // Too deep for more SAH splits: a leaf if it fits, else halve along the
+            // widest centroid extent
+            if (count <= size_t(maxLeafSize)) {
+                makeLeaf();
+                return;
+            }
+            bestAxis = 0;
+            for (int k = 1; k < 3; k++) {
+                if (centroidBounds.max[k] - centroidBounds.min[k] > centroidBounds.max[bestAxis] - centroidBounds.min[bestAxis]) bestAxis = k;
+            }
+            mid = begin + count / 2;
+            nth_element(entries.begin() + begin, entries.begin() + mid, entries.begin() + end,
+                [&](const BuildEntry& a, const BuildEntry& b) { return a.centroid[bestAxis] < b.centroid[bestAxis]; });
+        } else if (bestAxis == -1) {
+            // All centroids coincide: split by count if the leaf would be too big
+            if (count <= size_t(maxLeafSize)) {
+                makeLeaf();
+                return;
+            }
+            bestAxis = 0;
+            mid = begin + count / 2;
+        } else {
+            if (count <= size_t(maxLeafSize) && bestCost >= leafCost(count, bounds.surfaceArea())) {
+                makeLeaf();
+                return;
+            }
+            float cmin = centroidBounds.min[bestAxis];
+            float scale = SAH_BINS / (centroidBounds.max[bestAxis] - cmin);
+            auto it = partition(entries.begin() + begin, entries.begin() + end, [&](const BuildEntry& e) {
+                return std::min(SAH_BINS - 1, int((e.centroid[bestAxis] - cmin) * scale)) <= bestSplit;
+            });
+            mid = size_t(it - entries.begin());
+        }
+
+        nodes[nodeIndex].count = 0;
+        nodes[nodeIndex].axis = uint16_t(bestAxis);
+        build(begin, mid, depth + 1);
+        nodes[nodeIndex].offset = uint32_t(nodes.size());
+        build(mid, end, depth + 1);
+    }
+}
+
+void buildSAH(const vector<AABB>& boxes, int maxLeafSize, int leafWidth,
+              vector<BVHNode>& nodes, vector<uint32_t>& order) {
+    nodes.clear();
+    order.clear();
+    if (boxes.empty()) return;
+
+    SAHBuilder builder{{}, nodes, maxLeafSize, leafWidth};
+    builder.entries.reserve(boxes.size());
+    for (size_t i = 0; i < boxes.size(); i++) {
+        builder.entries.push_back({boxes[i], boxes[i].centroid(), uint32_t(i)});
+    }
+
+    nodes.reserve(2 * boxes.size() / std::max(1, leafWidth) + 1);
+    builder.build(0, boxes.size(), 0);
+
+    order.reserve(boxes.size());
+    for (const auto& e : builder.entries) order.push_back(e.index);
+}
+
+/*******
+ * BVH *
+ *******/
+
+void BVH::build(const vector<shared_ptr<Object3D>>& objects, const vector<uint32_t>& materialIds) {
+    nodes.clear();
+    primitives.clear();
+    unbounded.clear();
+
+    vector<AABB> boxes;
+    vector<PrimitiveRef> bounded;
+    boxes.reserve(objects.size());
+    bounded.reserve(objects.size());
+    for (size_t i = 0; i < objects.size(); i++) {
+        PrimitiveRef ref{objects[i].get(), uint32_t(i), materialIds[i]};
+        AABB box = objects[i]->isBounded() ? objects[i]->boundingBox() : AABB::infinite();
+        if (box.isInfinite()) {
+            unbounded.push_back(ref);
+        } else {
+            boxes.push_back(box);
+            bounded.push_back(ref);
+        }
+    }
+
+    vector<uint32_t> order;
+    buildSAH(boxes, MAX_LEAF_SIZE, 1, nodes, order);
+    primitives.reserve(order.size());
+    for (uint32_t i : order) primitives.push_back(bounded[i]);
+}
+
+optional<HitRecord> BVH::intersect(const Ray& ray, float maxDistance) const {
+    optional<HitRecord> closest = nullopt;
+
+    auto test = [&](const PrimitiveRef& ref) {
+        uint32_t element;
+        auto t = ref.object->hitElement(ray, element);
+        if (!t || *t >= maxDistance) return;
+        if (!closest || *t < closest->distance
+            || (*t == closest->distance && ref.index < closest->primitiveId)) {
+            closest = HitRecord{*t, ref.index, ref.material, element};
+        }
+    };
+
+    for (const auto& ref : unbounded) test(ref);
+
+    if (nodes.empty()) return closest;
+
+    const BoxRay boxRay(ray.origin, ray.direction);
+
+    uint32_t stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+        const BVHNode& node = nodes[stack[--stackSize]];
+        float tmax = closest ? std::min(closest->distance, maxDistance) : maxDistance;
+        if (!boxRay.hits(node, tmax)) continue;
+
+        if (node.count > 0) {
+            for (uint32_t i = 0; i < node.count; i++) test(primitives[node.offset + i]);
+        } else {
+            uint32_t left = uint32_t(&node - nodes.data()) + 1;
+            uint32_t right = node.offset;
+            // Push the far child first so the near one is visited next
+            if (boxRay.negative[node.axis]) {
+                stack[stackSize++] = left;
+                stack[stackSize++] = right;
+            } else {
+                stack[stackSize++] = right;
+                stack[stackSize++] = left;
+            }
+        }
+    }
+
+    return closest;
+}
+
+bool BVH::occluded(const Ray& ray, float maxDistance) const {
+    for (const auto& ref : unbounded) {
+        if (ref.object->intersectsP(ray, maxDistance)) return true;
+    }
+
+    if (nodes.empty()) return false;
+
+    const BoxRay boxRay(ray.origin, ray.direction);
+
+    uint32_t stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+        const BVHNode& node = nodes[stack[--stackSize]];
+        if (!boxRay.hits(node, maxDistance)) continue;
+
+        if (node.count > 0) {
+            for (uint32_t i = 0; i < node.count; i++) {
+                if (primitives[node.offset + i].object->intersectsP(ray, maxDistance)) return true;
+            }
+        } else {
+            stack[stackSize++] = node.offset;
+            stack[stackSize++] = uint32_t(&node - nodes.data()) + 1;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,151 @@
+#include "../include/cpu_topology.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+    // Parses a sysfs CPU list like "0-3,8-11"
+    std::vector<int> parseCpuList(const std::string& text) {
+        std::vector<int> result;
+        std::stringstream ss(text);
+        std::string range;
+        while (std::getline(ss, range, ',')) {
+            if (range.empty() || range == "\n") continue;
+            size_t dash = range.find('-');
+            try {
+                int first = std::stoi(range.substr(0, dash));
+                int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                for (int cpu = first; cpu <= last; cpu++) result.push_back(cpu);
+            } catch (const std::exception&) {
+                return {};
+            }
+        }
+        return result;
+    }
+
+    std::string readLine(const std::filesystem::path& path) {
+        std::ifstream file(path);
+        std::string line;
+        std::getline(file, line);
+        return line;
+    }
+
+    int readInt(const std::filesystem::path& path, int fallback) {
+        std::string line = readLine(path);
+        try {
+            return line.empty() ? fallback : std::stoi(line);
+        } catch (const std::exception&) {
+            return fallback;
+        }
+    }
+}
+
+/***************
+ * CpuTopology *
+ ***************/
+
+CpuTopology CpuTopology::discover(const std::string& root) {
+    namespace fs = std::filesystem;
+    CpuTopology topology;
+
+    std::vector<int> online = parseCpuList(readLine(fs::path(root) / "cpu" / "online"));
+    if (online.empty()) {
+        int count = std::max(1u, std::thread::hardware_concurrency());
+        for (int cpu = 0; cpu < count; cpu++) topology.cpus.push_back({cpu, 0, 0, cpu});
+        return topology;
+    }
+
+    for (int cpu : online) {
+        fs::path dir = fs::path(root) / "cpu" / ("cpu" + std::to_string(cpu)) / "topology";
+        topology.cpus.push_back({cpu, 0, readInt(dir / "physical_package_id", 0), readInt(dir / "core_id", cpu)});
+    }
+
+    // Node of each CPU from node/nodeN/cpulist; without NUMA sysfs, the socket stands in for it
+    std::vector<int> nodeIds;
+    std::error_code error;
+    for (const auto& entry : fs::directory_iterator(fs::path(root) / "node", error)) {
+        std::string name = entry.path().filename().string();
+        if (name.rfind("node", 0) != 0 || name.size() == 4 || !std::isdigit(name[4])) continue;
+        int node = std::stoi(name.substr(4));
+        for (int cpu : parseCpuList(readLine(entry.path() / "cpulist"))) {
+            for (Cpu& c : topology.cpus) {
+                if (c.id == cpu) c.node = node;
+            }
+        }
+        nodeIds.push_back(node);
+    }
+    if (nodeIds.empty()) {
+        for (Cpu& c : topology.cpus) {
+            c.node = c.package;
+            nodeIds.push_back(c.package);
+        }
+    }
+    std::sort(nodeIds.begin(), nodeIds.end());
+    nodeIds.erase(std::unique(nodeIds.begin(), nodeIds.end()), nodeIds.end());
+    topology.numNodes = std::max(1, int(nodeIds.size()));
+
+    // Hyperthread siblings end up next to each other, so spreading workers evenly
+    // takes one thread per core before doubling up
+    std::stable_sort(topology.cpus.begin(), topology.cpus.end(), [](const Cpu& a, const Cpu& b) {
+        if (a.node != b.node) return a.node < b.node;
+        if (a.package != b.package) return a.package < b.package;
+        return a.core < b.core;
+    });
+    return topology;
+}
+
+const CpuTopology& CpuTopology::system() {
+    static const CpuTopology topology = discover();
+    return topology;
+}
+
+std::vector<int> CpuTopology::placement(int numWorkers) const {
+    std::vector<int> result;
+    int numCpus = int(cpus.size());
+    for (int w = 0; w < numWorkers; w++) {
+        result.push_back(cpus[size_t(w) * numCpus / numWorkers].id);
+    }
+    return result;
+}
+
+int CpuTopology::nodeOf(int cpu) const {
+    for (const Cpu& c : cpus) {
+        if (c.id == cpu) return c.node;
+    }
+    return 0;
+}
+
+/******************
+ * ScopedAffinity *
+ ******************/
+
+ScopedAffinity::ScopedAffinity(int cpu) {
+    restore_ = pthread_getaffinity_np(pthread_self(), sizeof(previous_), &previous_) == 0;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pinned_ = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+ScopedAffinity::~ScopedAffinity() {
+    if (pinned_ && restore_) pthread_setaffinity_np(pthread_self(), sizeof(previous_), &previous_);
+}
+
+/****************
+ * releasePages *
+ ****************/
+
+bool releasePages(void* data, std::size_t bytes) {
+    const uintptr_t page = uintptr_t(sysconf(_SC_PAGESIZE));
+    uintptr_t begin = (uintptr_t(data) + page - 1) / page * page;
+    uintptr_t end = (uintptr_t(data) + bytes) / page * page;
+    if (end <= begin) return true;
+    return madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED) == 0;
+}
@@ -0,0 +1,260 @@
+#include "../include/foton.hpp"
+#include "../include/thread_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+    // Los subárboles con menos fotones los construye el hilo que llega a ellos
+    constexpr size_t UMBRAL_PARALELO = 1 << 15;
+
+    float signo(float v) { return v < 0.0f ? -1.0f : 1.0f; }
+
+    uint16_t cuantizar(float v) {
+        return uint16_t(lround((clamp(v, -1.0f, 1.0f) * 0.5f + 0.5f) * 65535.0f));
+    }
+
+    float decuantizar(uint16_t q) {
+        return q / 65535.0f * 2.0f - 1.0f;
+    }
+}
+
+/*********
+ * Foton *
+ *********/
+
+Foton::Foton(const Direction& d, const RGB& f) {
+    // Dirección: se proyecta sobre el octaedro |x|+|y|+|z| = 1 y la mitad inferior
+    // se pliega sobre la superior
+    float l1 = abs(d.x) + abs(d.y) + abs(d.z);
+    float u = l1 > 0.0f ? d.x / l1 : 0.0f;
+    float v = l1 > 0.0f ? d.y / l1 : 0.0f;
+    if (l1 > 0.0f && d.z < 0.0f) {
+        float pu = (1.0f - abs(v)) * signo(u);
+        float pv = (1.0f - abs(u)) * signo(v);
+        u = pu;
+        v = pv;
+    }
+    octaedro[0] = cuantizar(u);
+    octaedro[1] = cuantizar(v);
+
+    // Flujo: mantisas de 8 bits relativas al canal mayor
+    float r = max(f.r, 0.0f), g = max(f.g, 0.0f), b = max(f.b, 0.0f);
+    float mayor = max(r, max(g, b));
+    if (mayor < 1e-32f) {
+        rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+    } else {
+        int exponente;
+        float escala = frexp(mayor, &exponente) * 256.0f / mayor;
+        rgbe[0] = uint8_t(r * escala);
+        rgbe[1] = uint8_t(g * escala);
+        rgbe[2] = uint8_t(b * escala);
+        rgbe[3] = uint8_t(exponente + 128);
+    }
+}
+
+Direction Foton::direccion() const {
+    float u = decuantizar(octaedro[0]), v = decuantizar(octaedro[1]);
+    float w = 1.0f - abs(u) - abs(v);
+    if (w < 0.0f) {
+        float pu = (1.0f - abs(v)) * signo(u);
+        float pv = (1.0f - abs(u)) * signo(v);
+        u = pu;
+        v = pv;
+    }
+    return Direction(u, v, w).normalize();
+}
+
+RGB Foton::flujo() const {
+    if (rgbe[3] == 0) return RGB(0, 0, 0);
+    float escala = ldexp(1.0f, int(rgbe[3]) - (128 + 8));
+    return RGB((rgbe[0] + 0.5f) * escala, (rgbe[1] + 0.5f) * escala, (rgbe[2] + 0.5f) * escala);
+}
+
+/***************
+ * MapaFotones *
+ ***************/
+
+MapaFotones::MapaFotones(vector<FotonEmitido>&& emitidos, unsigned hilos) {
+    auto start = chrono::steady_clock::now();
+    size_t n = emitidos.size();
+    ejes.resize(n);
+    if (n > 0) {
+        // La caja se calcula una vez; cada hijo recibe la de su padre cortada por el plano
+        array<float, 3> bbmin, bbmax;
+        for (int k = 0; k < 3; k++) bbmin[k] = bbmax[k] = emitidos[0].pos[k];
+        for (const FotonEmitido& f : emitidos) {
+            for (int k = 0; k < 3; k++) {
+                bbmin[k] = min(bbmin[k], f.pos[k]);
+                bbmax[k] = max(bbmax[k], f.pos[k]);
+            }
+        }
+        construir(emitidos, 0, n, bbmin, bbmax, max(hilos, 1u));
+    }
+
+    // Las posiciones pasan a los arrays y el resto del fotón a fotones; los emitidos se
+    // liberan, así no queda una segunda copia de cada posición
+    x.resize(n);
+    y.resize(n);
+    z.resize(n);
+    fotones.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        x[i] = emitidos[i].pos[0];
+        y[i] = emitidos[i].pos[1];
+        z[i] = emitidos[i].pos[2];
+        fotones.push_back(emitidos[i].foton);
+    }
+    vector<FotonEmitido>().swap(emitidos);
+    buildSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void MapaFotones::construir(vector<FotonEmitido>& emitidos, size_t left, size_t right,
+                            array<float, 3> bbmin, array<float, 3> bbmax, unsigned hilos) {
+    if (right - left <= 1) return;
+
+    size_t median = (left + right) / 2;
+    // Se corta por el eje más largo de la caja
+    uint8_t eje = 0;
+    for (uint8_t k = 1; k < 3; k++) {
+        if (bbmax[k] - bbmin[k] > bbmax[eje] - bbmin[eje]) eje = k;
+    }
+    nth_element(emitidos.begin() + left, emitidos.begin() + median, emitidos.begin() + right,
+        [eje](const FotonEmitido& a, const FotonEmitido& b) { return a.pos[eje] < b.pos[eje]; });
+    ejes[median] = eje;
+
+    array<float, 3> leftMax = bbmax, rightMin = bbmin;
+    leftMax[eje] = rightMin[eje] = emitidos[median].pos[eje];
+    // Las dos mitades son rangos disjuntos de los mismos vectores. Van al pool compartido:
+    // si ningún hilo libre toma la derecha, la construye este mismo al esperar
+    if (hilos > 1 && right - left >= UMBRAL_PARALELO) {
+        ThreadPool::shared().run(2, [&](int mitad) {
+            if (mitad == 0) construir(emitidos, left, median, bbmin, leftMax, hilos - hilos / 2);
+            else construir(emitidos, median + 1, right, rightMin, bbmax, hilos / 2);
+        });
+    } else {
+        construir(emitidos, left, median, bbmin, leftMax, 1);
+        construir(emitidos, median + 1, right, rightMin, bbmax, 1);
+    }
+}
+
+BusquedaFotones MapaFotones::nearest_neighbors(const Point& p, float maxDistance, span<FotonCercano> vecinos) const {
+    const size_t k = vecinos.size();
+    if (k == 0 || fotones.empty()) return {0, 0.0f};
+
+    const float* coords[3] = {x.data(), y.data(), z.data()};
+    const float q[3] = {p.x, p.y, p.z};
+    auto masCercano = [](const FotonCercano& a, const FotonCercano& b) { return a.distance2 < b.distance2; };
+
+    // Un fotón se acepta si está más cerca que maxDistance2, que pasa a ser la distancia
+    // del más lejano en cuanto el montículo se llena
+    float maxDistance2 = maxDistance * maxDistance;
+    size_t n = 0;
+
+    // Subárboles pendientes con la distancia al cuadrado de p a su plano de corte. Se
+    // visita primero el lado del punto; el otro se descarta si al sacarlo de la pila el
+    // plano ya está más lejos que el fotón más lejano aceptado
+    struct Pendiente {
+        uint32_t left, right;
+        float plano2;
+    };
+    Pendiente pila[64];
+    int cima = 0;
+    pila[cima++] = {0, uint32_t(fotones.size()), 0.0f};
+
+    while (cima > 0) {
+        Pendiente actual = pila[--cima];
+        if (actual.plano2 >= maxDistance2) continue;
+        size_t left = actual.left, right = actual.right;
+
+        while (right > left) {
+            size_t median = (left + right) / 2;
+            float dx = q[0] - x[median], dy = q[1] - y[median], dz = q[2] - z[median];
+            float distance2 = dx * dx + dy * dy + dz * dz;
+            if (distance2 < maxDistance2) {
+                if (n < k) {
+                    vecinos[n++] = {distance2, &fotones[median]};
+                    push_heap(vecinos.begin(), vecinos.begin() + n, masCercano);
+                } else {
+                    pop_heap(vecinos.begin(), vecinos.end(), masCercano);
+                    vecinos[k - 1] = {distance2, &fotones[median]};
+                    push_heap(vecinos.begin(), vecinos.end(), masCercano);
+                }
+                if (n == k) maxDistance2 = vecinos[0].distance2;
+            }
+            if (right - left == 1) break;
+
+            int eje = ejes[median];
+            float plano = q[eje] - coords[eje][median];
+            if (plano < 0.0f) {
+                pila[cima++] = {uint32_t(median + 1), uint32_t(right), plano * plano};
+                right = median;
+            } else {
+                pila[cima++] = {uint32_t(left), uint32_t(median), plano * plano};
+                left = median + 1;
+            }
+        }
+    }
+    return {n, n > 0 ? vecinos[0].distance2 : 0.0f};
+}
+
+BusquedaFotones MapaFotones::en_radio(const Point& p, float radio, vector<FotonCercano>& vecinos) const {
+    vecinos.clear();
+    const float radio2 = radio * radio;
+    if (fotones.empty() || !(radio2 > 0.0f)) return {0, radio2};
+
+    const float* coords[3] = {x.data(), y.data(), z.data()};
+    const float q[3] = {p.x, p.y, p.z};
+
+    // Mismo recorrido que nearest_neighbors, pero la distancia de corte no se reduce
+    struct Pendiente {
+        uint32_t left, right;
+        float plano2;
+    };
+    Pendiente pila[64];
+    int cima = 0;
+    pila[cima++] = {0, uint32_t(fotones.size()), 0.0f};
+
+    while (cima > 0) {
+        Pendiente actual = pila[--cima];
+        if (actual.plano2 >= radio2) continue;
+        size_t left = actual.left, right = actual.right;
+
+        while (right > left) {
+            size_t median = (left + right) / 2;
+            float dx = q[0] - x[median], dy = q[1] - y[median], dz = q[2] - z[median];
+            float distance2 = dx * dx + dy * dy + dz * dz;
+            if (distance2 < radio2) vecinos.push_back({distance2, &fotones[median]});
+            if (right - left == 1) break;
+
+            int eje = ejes[median];
+            float plano = q[eje] - coords[eje][median];
+            if (plano < 0.0f) {
+                pila[cima++] = {uint32_t(median + 1), uint32_t(right), plano * plano};
+                right = median;
+            } else {
+                pila[cima++] = {uint32_t(left), uint32_t(median), plano * plano};
+                left = median + 1;
+            }
+        }
+    }
+    return {vecinos.size(), radio2};
+}
+
+vector<const Foton*> MapaFotones::nearest_neighbors(const Point& p, size_t k, float maxDistance) const {
+    vector<FotonCercano> vecinos(min(k, fotones.size()));
+    BusquedaFotones busqueda = nearest_neighbors(p, maxDistance, vecinos);
+
+    vector<const Foton*> encontrados;
+    encontrados.reserve(busqueda.encontrados);
+    for (size_t i = 0; i < busqueda.encontrados; i++) encontrados.push_back(vecinos[i].foton);
+    return encontrados;
+}
+
+size_t MapaFotones::memoryUsage() const {
+    return fotones.capacity() * sizeof(Foton)
+         + (x.capacity() + y.capacity() + z.capacity()) * sizeof(float)
+         + ejes.capacity() * sizeof(uint8_t);
+}
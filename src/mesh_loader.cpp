@@ -0,0 +1,385 @@
+#include "../include/mesh_loader.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+    // Read-only view of a whole file, mapped for the lifetime of the object
+    class MappedFile {
+    public:
+        explicit MappedFile(const std::string& path) {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) return;
+            struct stat info{};
+            if (::fstat(fd, &info) != 0) {
+                ::close(fd);
+                return;
+            }
+            if (info.st_size > 0) {
+                void* addr = ::mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr != MAP_FAILED) {
+                    ::madvise(addr, size_t(info.st_size), MADV_SEQUENTIAL);
+                    data_ = static_cast<const char*>(addr);
+                    size_ = size_t(info.st_size);
+                }
+            } else {
+                empty_ = true;
+            }
+            ::close(fd);
+        }
+
+        ~MappedFile() {
+            if (data_) ::munmap(const_cast<char*>(data_), size_);
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool ok() const { return data_ != nullptr || empty_; }
+        const char* begin() const { return data_; }
+        const char* end() const { return data_ + size_; }
+
+    private:
+        const char* data_ = nullptr;
+        size_t size_ = 0;
+        bool empty_ = false;
+    };
+
+    /*
+     * Text scanning over [p, end) without copies
+     */
+
+    bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    void skipBlanks(const char*& p, const char* end) {
+        while (p < end && isBlank(*p)) p++;
+    }
+
+    void skipLine(const char*& p, const char* end) {
+        const char* newline = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+        p = newline ? newline + 1 : end;
+    }
+
+    // Skips spaces and line breaks, for formats where they are equivalent
+    void skipWhitespace(const char*& p, const char* end) {
+        while (p < end && (isBlank(*p) || *p == '\n')) p++;
+    }
+
+    template <typename T>
+    bool parseNumber(const char*& p, const char* end, T& value) {
+        if (p < end && *p == '+') p++;     // from_chars does not take a leading '+'
+        auto [next, error] = std::from_chars(p, end, value);
+        if (error != std::errc()) return false;
+        p = next;
+        return true;
+    }
+
+    // Appends a polygon as a fan of triangles around its first vertex
+    void addPolygon(const std::vector<uint32_t>& polygon, std::vector<uint32_t>& indices) {
+        for (size_t i = 2; i < polygon.size(); i++) {
+            indices.push_back(polygon[0]);
+            indices.push_back(polygon[i - 1]);
+            indices.push_back(polygon[i]);
+        }
+    }
+
+    /*
+     * PLY
+     */
+
+    enum class PlyType { INT8, UINT8, INT16, UINT16, INT32, UINT32, FLOAT32, FLOAT64, INVALID };
+
+    PlyType plyType(std::string_view name) {
+        if (name == "char" || name == "int8") return PlyType::INT8;
+        if (name == "uchar" || name == "uint8") return PlyType::UINT8;
+        if (name == "short" || name == "int16") return PlyType::INT16;
+        if (name == "ushort" || name == "uint16") return PlyType::UINT16;
+        if (name == "int" || name == "int32") return PlyType::INT32;
+        if (name == "uint" || name == "uint32") return PlyType::UINT32;
+        if (name == "float" || name == "float32") return PlyType::FLOAT32;
+        if (name == "double" || name == "float64") return PlyType::FLOAT64;
+        return PlyType::INVALID;
+    }
+
+    size_t plySize(PlyType type) {
+        switch (type) {
+            case PlyType::INT8: case PlyType::UINT8: return 1;
+            case PlyType::INT16: case PlyType::UINT16: return 2;
+            case PlyType::INT32: case PlyType::UINT32: case PlyType::FLOAT32: return 4;
+            case PlyType::FLOAT64: return 8;
+            default: return 0;
+        }
+    }
+
+    struct PlyProperty {
+        std::string name;
+        PlyType type;
+        bool isList = false;
+        PlyType countType = PlyType::INVALID;
+    };
+
+    struct PlyElement {
+        std::string name;
+        size_t count;
+        std::vector<PlyProperty> properties;
+    };
+
+    template <typename T>
+    T readLittleEndian(const char* p) {
+        T value;
+        if constexpr (std::endian::native == std::endian::little || sizeof(T) == 1) {
+            std::memcpy(&value, p, sizeof(T));
+        } else {
+            char bytes[sizeof(T)];
+            std::reverse_copy(p, p + sizeof(T), bytes);
+            std::memcpy(&value, bytes, sizeof(T));
+        }
+        return value;
+    }
+
+    // Reads one binary value and moves p past it. The caller checks that it fits
+    double readBinary(const char*& p, PlyType type) {
+        double value = 0.0;
+        switch (type) {
+            case PlyType::INT8: value = readLittleEndian<int8_t>(p); break;
+            case PlyType::UINT8: value = readLittleEndian<uint8_t>(p); break;
+            case PlyType::INT16: value = readLittleEndian<int16_t>(p); break;
+            case PlyType::UINT16: value = readLittleEndian<uint16_t>(p); break;
+            case PlyType::INT32: value = readLittleEndian<int32_t>(p); break;
+            case PlyType::UINT32: value = readLittleEndian<uint32_t>(p); break;
+            case PlyType::FLOAT32: value = readLittleEndian<float>(p); break;
+            case PlyType::FLOAT64: value = readLittleEndian<double>(p); break;
+            default: break;
+        }
+        p += plySize(type);
+        return value;
+    }
+
+    // Next whitespace separated word of the header line starting at p
+    std::string_view nextWord(const char*& p, const char* lineEnd) {
+        skipBlanks(p, lineEnd);
+        const char* start = p;
+        while (p < lineEnd && !isBlank(*p)) p++;
+        return std::string_view(start, size_t(p - start));
+    }
+
+    bool isIndexList(const PlyProperty& property) {
+        return property.isList && (property.name == "vertex_indices" || property.name == "vertex_index");
+    }
+}
+
+std::optional<MeshData> loadMesh(const std::string& path) {
+    std::string extension = path.substr(path.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+    if (extension == "obj") {
+        return loadOBJ(path);
+    } else if (extension == "ply") {
+        return loadPLY(path);
+    }
+    std::cerr << "Invalid mesh extension in file " << path << ". Found " << extension << " instead of obj or ply" << std::endl;
+    return std::nullopt;
+}
+
+std::optional<MeshData> loadOBJ(const std::string& path) {
+    MappedFile file(path);
+    if (!file.ok()) {
+        std::cerr << "Error opening file " << path << std::endl;
+        return std::nullopt;
+    }
+
+    MeshData mesh;
+    std::vector<uint32_t> polygon;
+    size_t line = 1;
+    const char* p = file.begin();
+    const char* end = file.end();
+
+    auto fail = [&](const char* reason) {
+        std::cerr << "Error in OBJ file " << path << ", line " << line << ": " << reason << std::endl;
+        return std::nullopt;
+    };
+
+    for (; p < end; line++) {
+        skipBlanks(p, end);
+        if (end - p >= 2 && p[0] == 'v' && isBlank(p[1])) {
+            p += 2;
+            for (int k = 0; k < 3; k++) {
+                float coordinate;
+                skipBlanks(p, end);
+                if (!parseNumber(p, end, coordinate)) return fail("expected three vertex coordinates");
+                mesh.positions.push_back(coordinate);
+            }
+        } else if (end - p >= 2 && p[0] == 'f' && isBlank(p[1])) {
+            p += 2;
+            polygon.clear();
+            int64_t vertexCount = int64_t(mesh.positions.size() / 3);
+            while (true) {
+                skipBlanks(p, end);
+                if (p >= end || *p == '\n' || *p == '#') break;
+                int64_t index;
+                if (!parseNumber(p, end, index)) return fail("invalid face index");
+                // 1-based, or relative to the last vertex read if negative
+                index = index < 0 ? vertexCount + index : index - 1;
+                if (index < 0 || index >= vertexCount) return fail("face index out of range");
+                polygon.push_back(uint32_t(index));
+                // Texture and normal indices (v/vt/vn) are not used
+                while (p < end && !isBlank(*p) && *p != '\n') p++;
+            }
+            if (polygon.size() < 3) return fail("face with less than three vertices");
+            addPolygon(polygon, mesh.indices);
+        }
+        skipLine(p, end);
+    }
+
+    return mesh;
+}
+
+std::optional<MeshData> loadPLY(const std::string& path) {
+    MappedFile file(path);
+    if (!file.ok()) {
+        std::cerr << "Error opening file " << path << std::endl;
+        return std::nullopt;
+    }
+
+    auto fail = [&](const std::string& reason) {
+        std::cerr << "Error in PLY file " << path << ": " << reason << std::endl;
+        return std::nullopt;
+    };
+
+    const char* p = file.begin();
+    const char* end = file.end();
+
+    // Header: a few short text lines up to end_header
+    std::vector<PlyElement> elements;
+    bool binary = false, sawFormat = false, sawEnd = false;
+    for (bool first = true; p < end && !sawEnd; first = false) {
+        const char* lineStart = p;
+        skipLine(p, end);
+        const char* lineEnd = p;
+        const char* q = lineStart;
+        std::string_view keyword = nextWord(q, lineEnd);
+        while (!keyword.empty() && keyword.back() == '\n') keyword.remove_suffix(1);
+
+        if (first) {
+            if (keyword != "ply") return fail("missing ply signature");
+        } else if (keyword == "format") {
+            std::string_view format = nextWord(q, lineEnd);
+            if (format == "ascii") {
+                binary = false;
+            } else if (format == "binary_little_endian") {
+                binary = true;
+            } else {
+                return fail("unsupported format " + std::string(format));
+            }
+            sawFormat = true;
+        } else if (keyword == "element") {
+            PlyElement element;
+            element.name = std::string(nextWord(q, lineEnd));
+            std::string_view count = nextWord(q, lineEnd);
+            const char* c = count.data();
+            if (!parseNumber(c, count.data() + count.size(), element.count)) return fail("invalid element count");
+            elements.push_back(std::move(element));
+        } else if (keyword == "property") {
+            if (elements.empty()) return fail("property outside of an element");
+            PlyProperty property;
+            std::string_view type = nextWord(q, lineEnd);
+            if (type == "list") {
+                property.isList = true;
+                property.countType = plyType(nextWord(q, lineEnd));
+                type = nextWord(q, lineEnd);
+                if (property.countType == PlyType::INVALID) return fail("invalid list count type");
+            }
+            property.type = plyType(type);
+            if (property.type == PlyType::INVALID) return fail("invalid property type " + std::string(type));
+            std::string_view name = nextWord(q, lineEnd);
+            while (!name.empty() && name.back() == '\n') name.remove_suffix(1);
+            property.name = std::string(name);
+            elements.back().properties.push_back(std::move(property));
+        } else if (keyword == "end_header") {
+            sawEnd = true;
+        }
+        // comment, obj_info and unknown lines are ignored
+    }
+    if (!sawFormat || !sawEnd) return fail("incomplete header");
+
+    MeshData mesh;
+    std::vector<uint32_t> polygon;
+    size_t vertexCount = 0;
+
+    for (const PlyElement& element : elements) {
+        bool isVertex = element.name == "vertex";
+        bool isFace = element.name == "face";
+        int coordinate[3] = {-1, -1, -1};
+        if (isVertex) {
+            for (size_t i = 0; i < element.properties.size(); i++) {
+                const std::string& name = element.properties[i].name;
+                if (name == "x") coordinate[0] = int(i);
+                if (name == "y") coordinate[1] = int(i);
+                if (name == "z") coordinate[2] = int(i);
+            }
+            if (coordinate[0] < 0 || coordinate[1] < 0 || coordinate[2] < 0) return fail("vertices without x, y, z");
+            mesh.positions.reserve(mesh.positions.size() + 3 * element.count);
+            vertexCount = element.count;
+        }
+        if (isFace) mesh.indices.reserve(mesh.indices.size() + 3 * element.count);
+
+        for (size_t item = 0; item < element.count; item++) {
+            float position[3] = {0, 0, 0};
+            for (size_t i = 0; i < element.properties.size(); i++) {
+                const PlyProperty& property = element.properties[i];
+                bool indices = isFace && isIndexList(property);
+                size_t count = 1;
+
+                if (property.isList) {
+                    double listSize;
+                    if (binary) {
+                        if (size_t(end - p) < plySize(property.countType)) return fail("unexpected end of file");
+                        listSize = readBinary(p, property.countType);
+                    } else {
+                        skipWhitespace(p, end);
+                        if (!parseNumber(p, end, listSize)) return fail("invalid list size");
+                    }
+                    count = size_t(listSize);
+                    if (indices) polygon.clear();
+                }
+
+                if (binary && size_t(end - p) < count * plySize(property.type)) return fail("unexpected end of file");
+                for (size_t k = 0; k < count; k++) {
+                    double value;
+                    if (binary) {
+                        value = readBinary(p, property.type);
+                    } else {
+                        skipWhitespace(p, end);
+                        if (!parseNumber(p, end, value)) return fail("invalid value in " + element.name);
+                    }
+                    if (indices) {
+                        if (value < 0 || value >= double(vertexCount)) return fail("face index out of range");
+                        polygon.push_back(uint32_t(value));
+                    } else if (isVertex) {
+                        for (int axis = 0; axis < 3; axis++) {
+                            if (coordinate[axis] == int(i)) position[axis] = float(value);
+                        }
+                    }
+                }
+
+                if (indices) {
+                    if (polygon.size() < 3) return fail("face with less than three vertices");
+                    addPolygon(polygon, mesh.indices);
+                }
+            }
+            if (isVertex) mesh.positions.insert(mesh.positions.end(), position, position + 3);
+        }
+    }
+
+    return mesh;
+}
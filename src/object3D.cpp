@@ -1,16 +1,62 @@
 #include "constants.hpp"
 #include "../include/object3D.hpp"
+#include "../include/ray_packet.hpp"
+#include "../include/simd.hpp"
+#include "../include/thread_pool.hpp"
 
 #include <vector>
 #include <memory>
 #include <optional>
-#include <list>
 #include <string>
 #include <sstream>
 #include <fstream>
+#include <atomic>
 
 using namespace std;
 
+namespace {
+    // Flujo de los vecinos que llegan por el lado de la normal, cada uno pesado con
+    // K(r / rMax) / rMax^2. Se instancia para cada kernel, así no hay una llamada virtual
+    // por fotón: los pesos se calculan por lotes y se acumulan en float con SIMD
+    template <typename K>
+    RGB sumarFotones(const K& kernel, const FotonCercano* vecinos, size_t n, float radio2, const Direction& normal) {
+        constexpr size_t LOTE = 64;
+        alignas(32) float peso[LOTE], r[LOTE], g[LOTE], b[LOTE];
+        const float invRadio = 1.0f / sqrt(radio2);
+
+        simd::V sumaR = simd::set1(0.0f), sumaG = sumaR, sumaB = sumaR;
+        for (size_t inicio = 0; inicio < n; inicio += LOTE) {
+            size_t cuantos = min(LOTE, n - inicio);
+            size_t limite = (cuantos + simd::WIDTH - 1) / simd::WIDTH * simd::WIDTH;
+            for (size_t i = 0; i < limite; i++) {
+                peso[i] = r[i] = g[i] = b[i] = 0.0f;
+                if (i >= cuantos) continue;
+                const FotonCercano& vecino = vecinos[inicio + i];
+                if (normal * vecino.foton->direccion() >= 0.0) continue;
+                RGB flujo = vecino.foton->flujo();
+                peso[i] = kernel(sqrt(vecino.distance2) * invRadio);
+                r[i] = flujo.r;
+                g[i] = flujo.g;
+                b[i] = flujo.b;
+            }
+            for (size_t i = 0; i < limite; i += simd::WIDTH) {
+                simd::V w = simd::load(peso + i);
+                sumaR = simd::add(sumaR, simd::mul(w, simd::load(r + i)));
+                sumaG = simd::add(sumaG, simd::mul(w, simd::load(g + i)));
+                sumaB = simd::add(sumaB, simd::mul(w, simd::load(b + i)));
+            }
+        }
+
+        alignas(32) float total[3][simd::WIDTH];
+        simd::store(total[0], sumaR);
+        simd::store(total[1], sumaG);
+        simd::store(total[2], sumaB);
+        RGB suma(0, 0, 0);
+        for (int i = 0; i < simd::WIDTH; i++) suma = suma + RGB(total[0][i], total[1][i], total[2][i]);
+        return suma / radio2;
+    }
+}
+
 /*******
  * Ray *
  *******/
@@ -19,27 +65,141 @@ Point Ray::at(float t) const {
     return direction * t + origin;
 }
 
+/************
+ * Object3D *
+ ************/
+
+optional<Intersection> Object3D::intersect(const Ray& ray) const {
+    uint32_t element;
+    auto t = hitElement(ray, element);
+    if (!t) {
+        return nullopt;
+    }
+    Point point = ray.at(*t);
+    return Intersection(*t, point, normalAtElement(point, element), &material);
+}
+
+bool Object3D::intersectsP(const Ray& ray, float maxT) const {
+    auto t = hitDistance(ray);
+    return t && *t < maxT;
+}
+
 /*********
  * Scene *
  *********/
 
 void Scene::addObject(const shared_ptr<Object3D>& object) {
     objects.push_back(object);
+    objectMaterials.push_back(addMaterial(object->material));
+    bvhCache = make_shared<BVHCache>(); // The hierarchy is rebuilt on the next query
+}
+
+namespace {
+    bool sameMaterial(const Material& a, const Material& b) {
+        auto same = [](const RGB& x, const RGB& y) { return x.r == y.r && x.g == y.g && x.b == y.b; };
+        return same(a.diffuse, b.diffuse) && same(a.specular, b.specular) && same(a.transparency, b.transparency)
+            && a.p_diffuse == b.p_diffuse && a.p_specular == b.p_specular
+            && a.p_transparency == b.p_transparency && a.n == b.n && a.isEmissive == b.isEmissive;
+    }
+
+    // Hash of the fields compared by sameMaterial (std::hash gives 0.0 and -0.0 the same value)
+    size_t hashMaterial(const Material& m) {
+        size_t h = 0;
+        auto mix = [&h](size_t v) { h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2); };
+        for (const RGB* c : {&m.diffuse, &m.specular, &m.transparency}) {
+            mix(hash<float>()(c->r));
+            mix(hash<float>()(c->g));
+            mix(hash<float>()(c->b));
+        }
+        for (double v : {m.p_diffuse, m.p_specular, m.p_transparency, m.n}) mix(hash<double>()(v));
+        mix(m.isEmissive);
+        return h;
+    }
+}
+
+// Returns the id of the material, reusing an identical entry if there is one.
+// Only the entries with the same hash are compared
+uint32_t Scene::addMaterial(const Material& m) {
+    size_t h = hashMaterial(m);
+    auto [first, last] = materialIds.equal_range(h);
+    for (auto it = first; it != last; ++it) {
+        if (sameMaterial(materials[it->second], m)) return it->second;
+    }
+    materials.push_back(m);
+    uint32_t id = uint32_t(materials.size() - 1);
+    materialIds.emplace(h, id);
+    return id;
 }
 
 void Scene::addLight(const shared_ptr<PointLight>& light) {
     lights.push_back(light);
 }
 
+const BVH& Scene::bvh() const {
+    BVHCache& cache = *bvhCache;
+    call_once(cache.built, [&] { cache.bvh.build(objects, objectMaterials); });
+    return cache.bvh;
+}
+
+optional<HitRecord> Scene::closestHit(const Ray& ray, const float distance) const {
+    const BVH& accel = bvh();
+    if (accel.primitiveCount() == objects.size()) {
+        return accel.intersect(ray, distance);
+    }
+
+    // Objects pushed directly into the vector are not in the BVH: linear scan
+    optional<HitRecord> closest = nullopt;
+    for (size_t i = 0; i < objects.size(); i++) {
+        uint32_t element;
+        auto t = objects[i]->hitElement(ray, element);
+        if (t && (!closest || *t < closest->distance) && *t < distance) {
+            uint32_t materialId = i < objectMaterials.size() ? objectMaterials[i] : UINT32_MAX;
+            closest = HitRecord{*t, uint32_t(i), materialId, element};
+        }
+    }
+    return closest;
+}
+
+void Scene::closestHitPacket(const RayPacket& packet, PacketHits& hits) const {
+    const BVH& accel = bvh();
+    if (accel.primitiveCount() == objects.size()) {
+        accel.intersectPacket(packet, hits);
+        return;
+    }
+
+    // Same fallback as closestHit, one ray at a time
+    for (int i = 0; i < packet.count; i++) {
+        auto hit = closestHit(packet.rays[i], hits.distance[i]);
+        if (hit) hits.record(i, hit->distance, hit->primitiveId, hit->materialId, hit->elementId);
+    }
+}
+
+// Shading data for a hit: only computed once the closest hit is known
+Intersection Scene::surfaceAt(const Ray& ray, const HitRecord& hit) const {
+    const Object3D& object = *objects[hit.primitiveId];
+    const Material* material = hit.materialId < materials.size() ? &materials[hit.materialId] : &object.material;
+    Point point = ray.at(hit.distance);
+    return Intersection(hit.distance, point, object.normalAtElement(point, hit.elementId), material, hit.primitiveId, hit.materialId);
+}
+
 optional<Intersection> Scene::intersect(const Ray& ray, const float distance) const {
-    optional<Intersection> closest_intersection = nullopt;
+    auto hit = closestHit(ray, distance);
+    if (!hit) {
+        return nullopt;
+    }
+    return surfaceAt(ray, *hit);
+}
+
+bool Scene::occluded(const Ray& ray, float maxT) const {
+    const BVH& accel = bvh();
+    if (accel.primitiveCount() == objects.size()) {
+        return accel.occluded(ray, maxT);
+    }
+
     for (const auto& object : objects) {
-        auto intersection = object->intersect(ray);
-        if (intersection && (!closest_intersection || intersection->distance < closest_intersection->distance) && intersection->distance < distance) {
-            closest_intersection = intersection;
-        }
+        if (object->intersectsP(ray, maxT)) return true;
     }
-    return closest_intersection;
+    return false;
 }
 
 RGB Scene::calculateDirectLight(const Point& p) const {
@@ -57,9 +217,7 @@ RGB Scene::calculateDirectLight(const Point& p) const {
 
         // Create a ray from the point to the light
         Ray lightRay(p + lightDirection * EPSILON, lightDirection.normalize());
-        optional<Intersection> obstruction = intersect(lightRay, distanceToLight);
-
-        if (!obstruction) { // Si no hay obstaculos, consideramos la luz
+        if (!occluded(lightRay, distanceToLight)) { // Si no hay obstaculos, consideramos la luz
             RGB powerByDistance = currentLight->light / (distanceToLight * distanceToLight);
             directLight += powerByDistance;
         }
@@ -70,27 +228,80 @@ RGB Scene::calculateDirectLight(const Point& p) const {
 
 }
 
-MapaFotones Scene::generarMapaFotones(int nPaths, bool save, double sigma) const {
-    list<Foton> fotones;
+MapaFotones Scene::generarMapaFotones(int nPaths, bool save, double sigma, uint64_t seed, unsigned hilos,
+                                      SamplerType muestreo) const {
+    (void)save;
+    vector<FotonEmitido> fotones;
+    trazarFotones(nPaths, sigma, seed, hilos, muestreo, fotones, nullptr);
+    return construirMapaFotones(std::move(fotones), hilos);
+}
+
+MapasFotones Scene::generarMapasFotones(int nPaths, double sigma, uint64_t seed, unsigned hilos,
+                                        SamplerType muestreo) const {
+    vector<FotonEmitido> fotones, causticos;
+    trazarFotones(nPaths, sigma, seed, hilos, muestreo, fotones, &causticos);
+    return {construirMapaFotones(std::move(fotones), hilos), construirMapaFotones(std::move(causticos), hilos)};
+}
+
+void Scene::trazarFotones(int nPaths, double sigma, uint64_t seed, unsigned hilos, SamplerType muestreo,
+                          vector<FotonEmitido>& fotones, vector<FotonEmitido>* causticos) const {
+    // Los paseos se reparten en trozos de como mucho PASEOS_POR_TROZO paseos de la misma luz.
+    // Cada hilo coge el siguiente trozo libre y guarda sus fotones en los buffers del trozo;
+    // al final los buffers se juntan en orden, así los mapas no dependen del número de hilos
+    const int PASEOS_POR_TROZO = 1024;
+    struct Trozo {
+        size_t luz;
+        int inicio, fin, numFotones;
+        vector<FotonEmitido> fotones, causticos;
+    };
+    vector<Trozo> trozos;
+
     double totalEmision = 0.0;
     for (const auto& light : lights) totalEmision += light->light.max(); // Obtiene el total de emisión de todas las luces
-    for (const auto& light : lights) {
-        int numFotones = (int)(nPaths*light->light.max()/totalEmision); // Distribuye los paseos de fotones según la emisión de cada luz
-        for (int j = 0; j < numFotones; j++) {
-            Direction d = muestraAleatoriaUniforme(); // Muestra una dirección aleatoria en el ángulo sólido
-            Ray r = Ray(light->center, d);
-            RGB lightColor = light->light / numFotones; // Distribución uniforme de la luz
-            reboteFoton(r, RGB(lightColor.r*4*M_PI, lightColor.g*4*M_PI, lightColor.b*4*M_PI), fotones, fotones, save, sigma);
+    for (size_t i = 0; i < lights.size(); i++) {
+        int numFotones = (int)(nPaths*lights[i]->light.max()/totalEmision); // Distribuye los paseos de fotones según la emisión de cada luz
+        for (int inicio = 0; inicio < numFotones; inicio += PASEOS_POR_TROZO) {
+            trozos.push_back({i, inicio, min(inicio + PASEOS_POR_TROZO, numFotones), numFotones, {}, {}});
         }
     }
-    MapaFotones mapa = construirMapaFotones(fotones);
-    return mapa;  
+
+    atomic<size_t> siguiente{0};
+    auto trazarTrozos = [&]() {
+        for (size_t t = siguiente++; t < trozos.size(); t = siguiente++) {
+            Trozo& trozo = trozos[t];
+            const auto& light = lights[trozo.luz];
+            RGB lightColor = light->light / trozo.numFotones; // Distribución uniforme de la luz
+            vector<FotonEmitido>& destinoCausticos = causticos ? trozo.causticos : trozo.fotones;
+            for (int j = trozo.inicio; j < trozo.fin; j++) {
+                Sampler rng(muestreo, PCG32::mix(seed ^ PCG32::mix(trozo.luz)), uint64_t(j), uint32_t(j)); // Un generador por paseo: reproducible
+                Direction d = muestraAleatoriaUniforme(rng); // Muestra una dirección aleatoria en el ángulo sólido
+                Ray r = Ray(light->center, d);
+                reboteFoton(r, RGB(lightColor.r*4*M_PI, lightColor.g*4*M_PI, lightColor.b*4*M_PI), trozo.fotones, destinoCausticos, false, rng, false, sigma);
+            }
+        }
+    };
+
+    // Los hilos del pool compartido; el que llama también traza mientras espera
+    hilos = max(hilos, 1u);
+    ThreadPool::shared().run(int(hilos), [&](int) { trazarTrozos(); });
+
+    auto juntar = [&](vector<FotonEmitido>& destino, vector<FotonEmitido> Trozo::*buffer) {
+        size_t total = destino.size();
+        for (const Trozo& trozo : trozos) total += (trozo.*buffer).size();
+        destino.reserve(total);
+        for (Trozo& trozo : trozos) {
+            destino.insert(destino.end(), (trozo.*buffer).begin(), (trozo.*buffer).end());
+            vector<FotonEmitido>().swap(trozo.*buffer);
+        }
+    };
+    juntar(fotones, &Trozo::fotones);
+    if (causticos) juntar(*causticos, &Trozo::causticos);
 }
 
 // TODO: Revisar que funcione el código
 // Estas dos imágenes generan una lista de fotones en la escena
-void Scene::reboteFoton(const Ray& ray, const RGB& light, list<Foton>& fotones, 
-            list<Foton>& causticos, bool esCaustico, bool save, double sigma) const {
+void Scene::reboteFoton(const Ray& ray, const RGB& light, vector<FotonEmitido>& fotones, 
+            vector<FotonEmitido>& causticos, bool esCaustico, Sampler& rng, bool save, double sigma) const {
     
     (void)save; // Suppress unused parameter warning
     
@@ -122,8 +333,8 @@ void Scene::reboteFoton(const Ray& ray, const RGB& light, list<Foton>& fotones,
         }
         */
 
-        Material material = intersection->material;
-        double probability = rand0_1(); // Probabilidad aleatoria entre 0 y 1
+        const Material& material = *intersection->material;
+        double probability = rand0_1(rng); // Probabilidad aleatoria entre 0 y 1
         
         // Difuso
         if (probability <= material.p_diffuse) { 
@@ -131,7 +342,7 @@ void Scene::reboteFoton(const Ray& ray, const RGB& light, list<Foton>& fotones,
             if (ray.direction * normal > 0.0) {
                 normal = Direction(-normal.x, -normal.y, -normal.z); // Dirección del rayo * normal de la intersección
             } 
-            Foton f = Foton(intersection->point, wo, brdf);
+            FotonEmitido f(intersection->point, wo, brdf);
             if (!primerRebote) {
                 if (esCaustico) {
                     causticos.push_back(f);
@@ -141,7 +352,7 @@ void Scene::reboteFoton(const Ray& ray, const RGB& light, list<Foton>& fotones,
             }
             
             esCaustico = false;
-            wi = muestraAleatoriaUniforme(); // Obtención de una dirección aleatoria de la hemiesfera
+            wi = muestraAleatoriaUniforme(rng); // Obtención de una dirección aleatoria de la hemiesfera
             brdf = brdf * abs(wi * normal) * material.diffuse/material.p_diffuse; // BRDF difuso 
         } 
         
@@ -182,24 +393,23 @@ void Scene::reboteFoton(const Ray& ray, const RGB& light, list<Foton>& fotones,
 
 // TODO: Refactorizar nombres de variables y funciones
 RGB Scene::ecuacionRenderFotones(Point point, Direction wo, Material material, Direction normal, 
-    MapaFotones mapa, int kFotones, double radio, bool guardar, Kernel* kernel, double sigma) const {
+    const MapaFotones& mapa, int kFotones, double radio, bool guardar, const Kernel* kernel, Sampler& rng, double sigma,
+    const MapaFotones* causticos, int kCausticos, double radioCausticos) const {
     
     // Caso base
     if (material.isEmissive) {
         return material.diffuse;
     } 
 
-    double radioFotonMasLejano = 0.0;
-    double radioFoton = 0.0;
-    Point posFoton;
     RGB L = RGB(0, 0, 0);
 
-    double probability = rand0_1(); // Probabilidad aleatoria entre 0 y 1
+    double probability = rand0_1(rng); // Probabilidad aleatoria entre 0 y 1
 
-    // Seguimos hasta llegar a una superficie difusa, simulando el camino del foton
-    while (probability <= material.p_diffuse + material.p_specular + material.p_transparency) {
+    // Seguimos los rebotes especulares y refracciones hasta llegar a una superficie difusa
+    while (probability > material.p_diffuse &&
+           probability <= material.p_diffuse + material.p_specular + material.p_transparency) {
 
-        if (probability <= material.p_diffuse) {
+        if (probability <= material.p_diffuse + material.p_specular) {
             if (wo * normal > 0.0) {
                 normal = Direction(-normal.x, -normal.y, -normal.z); // Dirección del rayo * normal de la intersección
             } 
@@ -214,9 +424,9 @@ RGB Scene::ecuacionRenderFotones(Point point, Direction wo, Material material, D
             return L; // Si no hay intersección, se devuelve la luz acumulada
         } else {
             point = intersection->point;
-            material = intersection->material;
+            material = *intersection->material;
             normal = intersection->normal;
-            probability = rand0_1();
+            probability = rand0_1(rng);
         }
     }
 
@@ -226,31 +436,38 @@ RGB Scene::ecuacionRenderFotones(Point point, Direction wo, Material material, D
             normal = Direction(-normal.x, -normal.y, -normal.z); // Dirección del rayo * normal de la intersección
         } 
 
-        // Obtener fotones cercanos con radio r y máximo k
-        // Función nearest_neighbors de la clase MapaFotones proporcionada por los profesores
-        vector<const Foton*> fotones = mapa.nearest_neighbors(point, kFotones, radio);
-        
-        // Se obtiene el foton más lejano
-        for (const Foton* foton : fotones) {
-            posFoton = foton->posicion;
-            radioFoton = (posFoton - point).mod();
-            if (radioFoton > radioFotonMasLejano) radioFotonMasLejano = radioFoton;
-        }
-        for (const Foton* f : fotones) {
-            Direction wi = f->direccion;
-            double coseno = Direction(-normal.x, -normal.y, -normal.z) * wi;
-            if (coseno > 0.0) {
-                posFoton = f->posicion;
-                L = L + (material.diffuse / material.p_diffuse) * f->flujo
-                    *kernel->evaluar((posFoton - point).mod(), radioFotonMasLejano);
-            }
-        }
+        L = L + estimacionDensidad(mapa, point, normal, material, kFotones, radio, kernel);
+        // Las cáusticas se estiman aparte, con su propio radio y número de fotones
+        if (causticos) L = L + estimacionDensidad(*causticos, point, normal, material, kCausticos, radioCausticos, kernel);
         // Estimacion de la luz directa
         if (!guardar) L = L + estimacionSiguienteEvento(point, wo, material, normal, sigma);
     }
     return L;
 }
 
+// Estimación de densidad: suma el flujo de los fotones cercanos que llegan por el lado de la normal
+RGB Scene::estimacionDensidad(const MapaFotones& mapa, const Point& point, const Direction& normal,
+                              const Material& material, int kFotones, double radio, const Kernel* kernel) const {
+    // Obtener fotones cercanos con radio r y máximo k. Cada hilo reutiliza su buffer.
+    // Con k = 0 no hay máximo: se toman todos los fotones a menos de r
+    thread_local vector<FotonCercano> vecinos;
+    BusquedaFotones busqueda;
+    if (kFotones > 0) {
+        size_t k = size_t(kFotones);
+        if (vecinos.size() < k) vecinos.resize(k);
+        busqueda = mapa.nearest_neighbors(point, radio, span(vecinos.data(), k));
+    } else {
+        busqueda = mapa.en_radio(point, radio, vecinos);
+    }
+    if (busqueda.encontrados == 0 || busqueda.radio2 <= 0.0f) return RGB(0, 0, 0);
+
+    // Con máximo k el radio del kernel es la distancia del fotón más lejano; sin él, r
+    RGB flujo = visit([&](const auto& k) {
+        return sumarFotones(k, vecinos.data(), busqueda.encontrados, busqueda.radio2, normal);
+    }, *kernel);
+    return (material.diffuse / material.p_diffuse) * flujo;
+}
+
 // Devuelve la luz directa en un punto de la escena sobre una geometria difusa
 RGB Scene::estimacionSiguienteEvento(Point point, Direction wo, Material material, Direction n, double sigma) const {
     
@@ -267,8 +484,9 @@ RGB Scene::estimacionSiguienteEvento(Point point, Direction wo, Material materia
         double coseno = n * wi;
         RGB fr = material.diffuse / M_PI; // BRDF Lambertiano
         if (coseno > 0) {
-            auto interseccion = this->intersect(Ray(lights[i]->center, Direction(-wi.x, -wi.y, -wi.z)));
-            if (interseccion && interseccion->distance >= sqrt(norma) - EPSILON) {
+            // Visible si nada corta el segmento luz-punto antes de llegar al punto
+            Ray shadowRay(lights[i]->center, Direction(-wi.x, -wi.y, -wi.z));
+            if (!this->occluded(shadowRay, sqrt(norma) - EPSILON)) {
                 if (sigma == 0.0) L = L + (fr * coseno) * (lights[i]->light / norma);
                 else L = L + (fr * coseno) * (lights[i]->light / norma) * pow(M_E, -sigma * norma);
             }
@@ -296,10 +514,15 @@ string Sphere::toString() const {
     return oss.str();
 }
 
+AABB Sphere::boundingBox() const {
+    return AABB(Point(center.x - radius, center.y - radius, center.z - radius),
+                Point(center.x + radius, center.y + radius, center.z + radius));
+}
+
 /*
 Source: https://www.scratchapixel.com/lessons/3d-basic-rendering/minimal-ray-tracer-rendering-simple-shapes/ray-sphere-intersection.html
 */
-optional<Intersection> Sphere::intersect(const Ray& r) const {
+optional<float> Sphere::hitDistance(const Ray& r) const {
     
     Direction oc = center - r.origin;
     float tca = oc.dot(r.direction);
@@ -331,7 +554,7 @@ optional<Intersection> Sphere::intersect(const Ray& r) const {
         }
     }
 
-    return Intersection(t, r.at(t), (r.at(t) - center).normalize(), material);
+    return t;
     
     /*
     Direction oc = center - r.origin;
@@ -361,13 +584,35 @@ optional<Intersection> Sphere::intersect(const Ray& r) const {
     */
 }
 
+bool Sphere::intersectsP(const Ray& r, float maxT) const {
+    Direction oc = center - r.origin;
+    float tca = oc.dot(r.direction);
+    if (tca < 0) {
+        return false;
+    }
+
+    float d2 = oc.dot(oc) - tca * tca;
+    if (d2 > radius * radius) {
+        return false;
+    }
+
+    // The near root if it is in front of the origin, the far one otherwise
+    float thc = sqrt(radius * radius - d2);
+    float t = (tca - thc >= 0) ? tca - thc : tca + thc;
+    return t < maxT;
+}
+
+Direction Sphere::normalAt(const Point& point) const {
+    return (point - center).normalize();
+}
+
 
 /*********
  * Plane *
  *********/
 
 // Source: https://www.scratchapixel.com/lessons/3d-basic-rendering/minimal-ray-tracer-rendering-simple-shapes/ray-plane-and-ray-disk-intersection.html
-optional<Intersection> Plane::intersect(const Ray& r) const {
+optional<float> Plane::hitDistance(const Ray& r) const {
     float denominator = normal.dot(r.direction);
     
     // If the ray is parallel to the plane, there is no intersection
@@ -381,7 +626,25 @@ optional<Intersection> Plane::intersect(const Ray& r) const {
     if (t < 0)
         return nullopt;
 
-    return Intersection(t, r.at(t), normal, material);
+    return t;
+}
+
+bool Plane::intersectsP(const Ray& r, float maxT) const {
+    float denominator = normal.dot(r.direction);
+    if (abs(denominator) < EPSILON)
+        return false;
+
+    Point base = Point(normal.x, normal.y, normal.z) * distance;
+    float t = normal.dot(base - r.origin) / denominator;
+    return t >= 0 && t < maxT;
+}
+
+Direction Plane::normalAt(const Point&) const {
+    return normal;
+}
+
+AABB Plane::boundingBox() const {
+    return AABB::infinite();
 }
 
 float Plane::distanceTo(const Point& point) const {
@@ -400,7 +663,7 @@ string Plane::toString() const {
  ************/
 
 // Möller-Trumbore intersection algorithm
-optional<Intersection> Triangle::intersect(const Ray& r) const {
+optional<float> Triangle::hitDistance(const Ray& r) const {
     const float EPS = 1e-8f;
     
     Direction edge1 = b - a;
@@ -431,13 +694,41 @@ optional<Intersection> Triangle::intersect(const Ray& r) const {
 
     // Check if the intersection point is in front of the ray origin
     if (t > EPS) {
-        Point intersectionPoint = r.at(t);
-        return Intersection(t, intersectionPoint, normal, material);
+        return t;
     } else {
         return nullopt;
     }
 }
 
+bool Triangle::intersectsP(const Ray& r, float maxT) const {
+    const float EPS = 1e-8f;
+
+    Direction edge1 = b - a;
+    Direction edge2 = c - a;
+    Direction h = r.direction.cross(edge2);
+    float a_det = edge1.dot(h);
+    if (abs(a_det) < EPS)
+        return false;
+
+    float f = 1.0f / a_det;
+    Direction s = r.origin - a;
+    float u = f * s.dot(h);
+    if (u < 0.0f || u > 1.0f)
+        return false;
+
+    Direction q = s.cross(edge1);
+    float v = f * r.direction.dot(q);
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+
+    float t = f * edge2.dot(q);
+    return t > EPS && t < maxT;
+}
+
+Direction Triangle::normalAt(const Point&) const {
+    return normal;
+}
+
 string Triangle::toString() const {
     ostringstream oss;
     oss << "A: " << a << "\n"
@@ -446,11 +737,19 @@ string Triangle::toString() const {
     return oss.str();
 }
 
+AABB Triangle::boundingBox() const {
+    AABB box;
+    box.expand(a);
+    box.expand(b);
+    box.expand(c);
+    return box;
+}
+
 /********
  * Cone *
  ********/
 
-optional<Intersection> Cone::intersect(const Ray& ray) const {
+optional<float> Cone::hitDistance(const Ray& ray) const {
     const float EPS = 1e-8f;
     
     // Transform ray to cone's local coordinate system
@@ -491,12 +790,44 @@ optional<Intersection> Cone::intersect(const Ray& ray) const {
         return nullopt;
     }
 
-    // Calculate normal at intersection point
+    return t;
+}
+
+bool Cone::intersectsP(const Ray& ray, float maxT) const {
+    const float EPS = 1e-8f;
+
+    Direction co = ray.origin - base;
+    float k = radius / height;
+    k = k * k;
+
+    float a = ray.direction.x * ray.direction.x + ray.direction.z * ray.direction.z - k * ray.direction.y * ray.direction.y;
+    float b = 2.0f * (co.x * ray.direction.x + co.z * ray.direction.z - k * (height - co.y) * (-ray.direction.y));
+    float c = co.x * co.x + co.z * co.z - k * (height - co.y) * (height - co.y);
+
+    float discriminant = b * b - 4.0f * a * c;
+    if (discriminant < 0) {
+        return false;
+    }
+
+    float sqrt_discriminant = sqrt(discriminant);
+    float t1 = (-b - sqrt_discriminant) / (2.0f * a);
+    float t2 = (-b + sqrt_discriminant) / (2.0f * a);
+
+    // Same root as hitDistance; beyond maxT there is no need to check the height
+    float t = (t1 > EPS) ? t1 : t2;
+    if (t <= EPS || t >= maxT) {
+        return false;
+    }
+
+    float y = ray.origin.y + ray.direction.y * t - base.y;
+    return y >= 0 && y <= height;
+}
+
+Direction Cone::normalAt(const Point& point) const {
     // For a cone, normal at (x, y, z) is (x, -radius²/height, z) normalized
+    Direction localPoint = point - base;
     float normalY = -radius * radius / height;
-    Direction normal = Direction(localPoint.x, normalY, localPoint.z).normalize();
-    
-    return Intersection(t, intersectionPoint, normal, material);
+    return Direction(localPoint.x, normalY, localPoint.z).normalize();
 }
 
 string Cone::toString() const {
@@ -505,11 +836,17 @@ string Cone::toString() const {
     return ss.str();
 }
 
+// The intersection assumes the axis is +Y, so the bounds do too
+AABB Cone::boundingBox() const {
+    return AABB(Point(base.x - radius, base.y, base.z - radius),
+                Point(base.x + radius, base.y + height, base.z + radius));
+}
+
 /*************
  * Cylinder *
  *************/
 
-optional<Intersection> Cylinder::intersect(const Ray& ray) const {
+optional<float> Cylinder::hitDistance(const Ray& ray) const {
     const float EPS = 1e-8f;
     
     // Transform ray to cylinder's local coordinate system
@@ -564,14 +901,43 @@ optional<Intersection> Cylinder::intersect(const Ray& ray) const {
         return nullopt;
     }
 
-    Point intersectionPoint = ray.at(t);
-    Direction localPoint = intersectionPoint - base;
-    
-    // Calculate normal at intersection point
+    return t;
+}
+
+bool Cylinder::intersectsP(const Ray& ray, float maxT) const {
+    const float EPS = 1e-8f;
+
+    Direction co = ray.origin - base;
+    float a = ray.direction.x * ray.direction.x + ray.direction.z * ray.direction.z;
+    if (abs(a) < EPS) {
+        return false;
+    }
+
+    float b = 2.0f * (co.x * ray.direction.x + co.z * ray.direction.z);
+    float c = co.x * co.x + co.z * co.z - radius * radius;
+
+    float discriminant = b * b - 4.0f * a * c;
+    if (discriminant < 0) {
+        return false;
+    }
+
+    // a > 0, so t1 <= t2: the first root inside the height range is the closest hit
+    float sqrt_discriminant = sqrt(discriminant);
+    float t1 = (-b - sqrt_discriminant) / (2.0f * a);
+    float t2 = (-b + sqrt_discriminant) / (2.0f * a);
+    for (float t : {t1, t2}) {
+        if (t <= EPS) continue;
+        if (t >= maxT) return false;
+        float y = ray.origin.y + ray.direction.y * t - base.y;
+        if (y >= 0 && y <= height) return true;
+    }
+    return false;
+}
+
+Direction Cylinder::normalAt(const Point& point) const {
     // For a cylinder, normal is perpendicular to the axis and pointing outward
-    Direction normal = Direction(localPoint.x, 0, localPoint.z).normalize();
-    
-    return Intersection(t, intersectionPoint, normal, material);
+    Direction localPoint = point - base;
+    return Direction(localPoint.x, 0, localPoint.z).normalize();
 }
 
 string Cylinder::toString() const {
@@ -579,4 +945,10 @@ string Cylinder::toString() const {
     ss << "Cylinder(base: " << base.toString() << ", axis: " << axis.toString() 
        << ", radius: " << radius << ", height: " << height << ")";
     return ss.str();
-}
\ No newline at end of file
+}
+
+// The intersection assumes the axis is +Y, so the bounds do too
+AABB Cylinder::boundingBox() const {
+    return AABB(Point(base.x - radius, base.y, base.z - radius),
+                Point(base.x + radius, base.y + height, base.z + radius));
+}
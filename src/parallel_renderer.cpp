@@ -1,9 +1,46 @@
 #include "../include/parallel_renderer.hpp"
+#include "../include/adaptive_sampler.hpp"
 #include "../include/pinholeCamera.hpp"
 #include "../include/rendering_strategy.hpp"
+#include "../include/cpu_topology.hpp"
 #include <chrono>
 #include <iostream>
 #include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <optional>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * TileBuffer Implementation
+ */
+TileView TileBuffer::reset(const RenderTask& task) {
+    tileWidth_ = task.endX - task.startX;
+    tileHeight_ = task.endY - task.startY;
+    // 16 pixels are 192 bytes, 3 whole cache lines: rows padded to a multiple of 16
+    // pixels all start on a line if the first one does
+    constexpr int ROW_PIXELS = 16;
+    int stride = (tileWidth_ + ROW_PIXELS - 1) / ROW_PIXELS * ROW_PIXELS;
+    size_t needed = size_t(stride) * tileHeight_ + ROW_PIXELS;
+    if (storage_.size() < needed) storage_.resize(needed);
+
+    // One of the first 16 pixels of the storage sits on a line boundary
+    size_t first = 0;
+    while (reinterpret_cast<uintptr_t>(storage_.data() + first) % CACHE_LINE != 0 && first + 1 < ROW_PIXELS) first++;
+    view_ = {storage_.data() + first, task.startX, task.startY, stride};
+    return view_;
+}
+
+void TileBuffer::commit(RGB* pixels, int width) const {
+    for (int row = 0; row < tileHeight_; ++row) {
+        const RGB* source = view_.data + size_t(row) * view_.stride;
+        std::copy(source, source + tileWidth_, pixels + size_t(view_.startY + row) * width + view_.startX);
+    }
+}
 
 /**
  * StandardTaskQueue Implementation
@@ -42,6 +79,267 @@ void StandardTaskQueue::finish() {
     condition_.notify_all();
 }
 
+/**
+ * LockFreeTaskQueue Implementation
+ * Source: https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+ */
+LockFreeTaskQueue::LockFreeTaskQueue(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) size <<= 1;
+    buffer_ = std::make_unique<Cell[]>(size);
+    mask_ = size - 1;
+    for (size_t i = 0; i < size; ++i) {
+        buffer_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+void LockFreeTaskQueue::push(const RenderTask& task) {
+    size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = buffer_[pos & mask_];
+        size_t seq = cell.sequence.load(std::memory_order_acquire);
+        intptr_t diff = intptr_t(seq) - intptr_t(pos);
+        if (diff == 0) { // Free cell: try to claim it
+            if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                cell.task = task;
+                cell.sequence.store(pos + 1, std::memory_order_release);
+                return;
+            }
+        } else if (diff < 0) {
+            throw std::length_error("LockFreeTaskQueue is full");
+        } else { // Another producer took it, reload
+            pos = enqueuePos_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool LockFreeTaskQueue::pop(RenderTask& task) {
+    size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = buffer_[pos & mask_];
+        size_t seq = cell.sequence.load(std::memory_order_acquire);
+        intptr_t diff = intptr_t(seq) - intptr_t(pos + 1);
+        if (diff == 0) { // Full cell: try to consume it
+            if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                task = cell.task;
+                cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false; // Empty
+        } else { // Another consumer took it, reload
+            pos = dequeuePos_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool LockFreeTaskQueue::empty() const {
+    return size() == 0;
+}
+
+size_t LockFreeTaskQueue::size() const {
+    size_t enq = enqueuePos_.load(std::memory_order_relaxed);
+    size_t deq = dequeuePos_.load(std::memory_order_relaxed);
+    return enq > deq ? enq - deq : 0;
+}
+
+/**
+ * WorkStealingDeque Implementation
+ * Memory orderings follow Le et al., "Correct and Efficient Work-Stealing for
+ * Weak Memory Models" (PPoPP 2013).
+ */
+void WorkStealingDeque::reset(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+    buffer_.assign(size, RenderTask());
+    mask_ = size - 1;
+    top_.store(0, std::memory_order_relaxed);
+    bottom_.store(0, std::memory_order_relaxed);
+}
+
+void WorkStealingDeque::push(const RenderTask& task) {
+    int64_t b = bottom_.load(std::memory_order_relaxed);
+    int64_t t = top_.load(std::memory_order_acquire);
+    if (b - t > int64_t(mask_)) {
+        throw std::length_error("WorkStealingDeque is full");
+    }
+    buffer_[b & mask_] = task;
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(b + 1, std::memory_order_relaxed);
+}
+
+bool WorkStealingDeque::pop(RenderTask& task) {
+    int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top_.load(std::memory_order_relaxed);
+
+    if (t > b) { // Empty
+        bottom_.store(b + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    task = buffer_[b & mask_];
+    if (t == b) { // Last task: race against thieves for it
+        bool won = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+        return won;
+    }
+    return true;
+}
+
+WorkStealingDeque::StealResult WorkStealingDeque::steal(RenderTask& task) {
+    int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom_.load(std::memory_order_acquire);
+
+    if (t >= b) {
+        return StealResult::EMPTY;
+    }
+
+    RenderTask stolen = buffer_[t & mask_];
+    if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return StealResult::ABORT; // Lost the race against the owner or another thief
+    }
+    task = stolen;
+    return StealResult::SUCCESS;
+}
+
+size_t WorkStealingDeque::size() const {
+    int64_t b = bottom_.load(std::memory_order_relaxed);
+    int64_t t = top_.load(std::memory_order_relaxed);
+    return b > t ? size_t(b - t) : 0;
+}
+
+/**
+ * WorkStealingTaskQueue Implementation
+ */
+WorkStealingTaskQueue::WorkStealingTaskQueue(int numWorkers) {
+    for (int i = 0; i < std::max(1, numWorkers); ++i) {
+        deques_.push_back(std::make_unique<WorkStealingDeque>());
+    }
+}
+
+// Tasks are staged until finish(), which must happen before the workers start
+void WorkStealingTaskQueue::push(const RenderTask& task) {
+    pending_.push_back(task);
+}
+
+void WorkStealingTaskQueue::finish() {
+    size_t numWorkers = deques_.size();
+    size_t numTasks = pending_.size();
+    for (size_t w = 0; w < numWorkers; ++w) {
+        size_t begin = w * numTasks / numWorkers;
+        size_t end = (w + 1) * numTasks / numWorkers;
+        deques_[w]->reset(end - begin);
+        // Reverse order so the owner pops its range front to back
+        for (size_t i = end; i > begin; --i) {
+            deques_[w]->push(pending_[i - 1]);
+        }
+    }
+    pending_.clear();
+    pending_.shrink_to_fit();
+}
+
+bool WorkStealingTaskQueue::steal(RenderTask& task, int firstVictim, int thief) {
+    int numWorkers = int(deques_.size());
+    bool byNode = thief >= 0 && thief < int(nodes_.size()) && int(nodes_.size()) == numWorkers;
+    // First pass only on the thief's node, second one on every worker
+    for (int pass = byNode ? 0 : 1; pass < 2; ++pass) {
+        bool contended = true;
+        while (contended) {
+            contended = false;
+            for (int i = 0; i < numWorkers; ++i) {
+                int victim = (firstVictim + i) % numWorkers;
+                if (pass == 0 && nodes_[victim] != nodes_[thief]) continue;
+                switch (deques_[victim]->steal(task)) {
+                    case WorkStealingDeque::StealResult::SUCCESS:
+                        return true;
+                    case WorkStealingDeque::StealResult::ABORT:
+                        contended = true;
+                        break;
+                    case WorkStealingDeque::StealResult::EMPTY:
+                        break;
+                }
+            }
+        }
+    }
+    // No task is pushed once the workers run, so empty deques stay empty
+    return false;
+}
+
+bool WorkStealingTaskQueue::pop(RenderTask& task) {
+    return steal(task, 0);
+}
+
+bool WorkStealingTaskQueue::pop(RenderTask& task, int workerId) {
+    int numWorkers = int(deques_.size());
+    if (workerId < 0 || workerId >= numWorkers) {
+        return steal(task, 0);
+    }
+    if (deques_[workerId]->pop(task)) {
+        return true;
+    }
+    return steal(task, (workerId + 1) % numWorkers, workerId);
+}
+
+bool WorkStealingTaskQueue::empty() const {
+    return size() == 0;
+}
+
+size_t WorkStealingTaskQueue::size() const {
+    size_t total = pending_.size();
+    for (const auto& d : deques_) total += d->size();
+    return total;
+}
+
+/**
+ * GuidedTaskQueue Implementation
+ */
+GuidedTaskQueue::GuidedTaskQueue(int numWorkers, int minSize)
+    : numWorkers_(std::max(1, numWorkers)), minSize_(std::max(1, minSize)) {}
+
+void GuidedTaskQueue::push(const RenderTask& task) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(task);
+    nextId_ = std::max(nextId_, task.taskId + 1);
+}
+
+bool GuidedTaskQueue::pop(RenderTask& task) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queue_.empty()) {
+        return false;
+    }
+    task = queue_.front();
+    queue_.pop_front();
+
+    // Not enough tiles left for everyone: keep half of this one and leave the other half
+    while (queue_.size() < size_t(numWorkers_ - 1)) {
+        int w = task.endX - task.startX, h = task.endY - task.startY;
+        if (std::max(w, h) < 2 * minSize_) break;
+
+        RenderTask rest = task;
+        rest.taskId = nextId_++;
+        if (w >= h) {
+            task.endX = rest.startX = task.startX + w / 2;
+        } else {
+            task.endY = rest.startY = task.startY + h / 2;
+        }
+        queue_.push_front(rest);
+    }
+    return true;
+}
+
+bool GuidedTaskQueue::empty() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.empty();
+}
+
+size_t GuidedTaskQueue::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+}
+
 /**
  * TaskGenerator Implementation
  */
@@ -55,6 +353,10 @@ std::vector<RenderTask> TaskGenerator::generateTasks(int width, int height, cons
             return generateColumnTasks(width, height, config.regionSize);
         case RegionType::RECTANGLE:
             return generateRectangleTasks(width, height, config.regionSize);
+        case RegionType::HILBERT:
+        case RegionType::MORTON:
+        case RegionType::SPIRAL:
+            return generateCurveTasks(width, height, config.regionSize, config.regionType);
         default:
             return generateRectangleTasks(width, height, config.regionSize);
     }
@@ -109,21 +411,90 @@ std::vector<RenderTask> TaskGenerator::generateRectangleTasks(int width, int hei
     return tasks;
 }
 
+namespace {
+    // Position of tile (x, y) along the Hilbert curve that covers an n x n grid, n a power of two
+    uint64_t hilbertIndex(uint32_t n, uint32_t x, uint32_t y) {
+        uint64_t d = 0;
+        for (uint32_t s = n / 2; s > 0; s /= 2) {
+            uint32_t rx = (x & s) > 0, ry = (y & s) > 0;
+            d += uint64_t(s) * s * ((3 * rx) ^ ry);
+            // Rotate the quadrant so that the curve inside it starts where the previous one ended
+            if (ry == 0) {
+                if (rx == 1) {
+                    x = s - 1 - (x & (s - 1)) + (x & ~(s - 1));
+                    y = s - 1 - (y & (s - 1)) + (y & ~(s - 1));
+                }
+                std::swap(x, y);
+            }
+        }
+        return d;
+    }
+
+    // Interleaves the bits of x and y
+    uint64_t mortonIndex(uint32_t x, uint32_t y) {
+        uint64_t d = 0;
+        for (int bit = 0; bit < 32; bit++) {
+            d |= uint64_t((x >> bit) & 1) << (2 * bit);
+            d |= uint64_t((y >> bit) & 1) << (2 * bit + 1);
+        }
+        return d;
+    }
+}
+
+std::vector<RenderTask> TaskGenerator::generateCurveTasks(int width, int height, int blockSize, RegionType order) {
+    std::vector<RenderTask> tiles = generateRectangleTasks(width, height, blockSize);
+    const int tilesX = (width + blockSize - 1) / blockSize, tilesY = (height + blockSize - 1) / blockSize;
+    uint32_t side = 1;
+    while (side < uint32_t(std::max(tilesX, tilesY))) side *= 2;
+
+    // Tiles come row by row from generateRectangleTasks, so tile i is (i % tilesX, i / tilesX)
+    std::vector<double> key(tiles.size());
+    for (size_t i = 0; i < tiles.size(); i++) {
+        uint32_t tx = uint32_t(i % tilesX), ty = uint32_t(i / tilesX);
+        switch (order) {
+            case RegionType::HILBERT:
+                key[i] = double(hilbertIndex(side, tx, ty));
+                break;
+            case RegionType::MORTON:
+                key[i] = double(mortonIndex(tx, ty));
+                break;
+            default: {
+                // Ring first, then angle inside the ring
+                double dx = tx + 0.5 - tilesX / 2.0, dy = ty + 0.5 - tilesY / 2.0;
+                double ring = std::floor(std::max(std::fabs(dx), std::fabs(dy)));
+                key[i] = ring * 8.0 + (std::atan2(dy, dx) + M_PI);
+                break;
+            }
+        }
+    }
+
+    std::vector<size_t> sorted(tiles.size());
+    std::iota(sorted.begin(), sorted.end(), 0);
+    std::stable_sort(sorted.begin(), sorted.end(), [&](size_t a, size_t b) { return key[a] < key[b]; });
+
+    std::vector<RenderTask> tasks;
+    tasks.reserve(tiles.size());
+    for (size_t i : sorted) {
+        RenderTask task = tiles[i];
+        task.taskId = int(tasks.size());
+        tasks.push_back(task);
+    }
+    return tasks;
+}
+
 /**
  * QueueFactory Implementation
  */
-std::unique_ptr<TaskQueue> QueueFactory::createQueue(QueueType type) {
+std::unique_ptr<TaskQueue> QueueFactory::createQueue(QueueType type, int numWorkers, size_t capacity) {
     switch (type) {
         case QueueType::STD_QUEUE:
             return std::make_unique<StandardTaskQueue>();
         case QueueType::LOCK_FREE_QUEUE:
-            // Future implementation
-            std::cerr << "Lock-free queue not implemented yet, using standard queue\n";
-            return std::make_unique<StandardTaskQueue>();
+            return std::make_unique<LockFreeTaskQueue>(capacity > 0 ? capacity : 1 << 16);
         case QueueType::WORK_STEALING:
-            // Future implementation
-            std::cerr << "Work-stealing queue not implemented yet, using standard queue\n";
-            return std::make_unique<StandardTaskQueue>();
+            return std::make_unique<WorkStealingTaskQueue>(numWorkers);
+        case QueueType::GUIDED:
+            return std::make_unique<GuidedTaskQueue>(numWorkers);
         default:
             return std::make_unique<StandardTaskQueue>();
     }
@@ -132,8 +503,8 @@ std::unique_ptr<TaskQueue> QueueFactory::createQueue(QueueType type) {
 /**
  * ParallelRenderer Implementation
  */
-ParallelRenderer::ParallelRenderer(const RenderConfig& config)
-    : config_(config) {}
+ParallelRenderer::ParallelRenderer(const RenderConfig& config, ThreadPool* pool)
+    : config_(config), pool_(pool ? pool : &ThreadPool::shared()) {}
 
 // Unified parallel render entry point
 Image ParallelRenderer::render(const PinholeCamera& camera,
@@ -141,9 +512,68 @@ Image ParallelRenderer::render(const PinholeCamera& camera,
                                unsigned samplesPerPixel,
                                const RenderConfig& cfg) {
     config_ = cfg;
+    if (cfg.adaptiveSampling) {
+        AdaptiveSampler::Result result = AdaptiveSampler::render(camera, scene, samplesPerPixel, cfg, pool_);
+        if (!cfg.heatmapPath.empty()) result.heatmap.writePPM(cfg.heatmapPath);
+        return std::move(result.image);
+    }
     return runParallel(camera, scene, samplesPerPixel, cfg);
 }
 
+ParallelRenderer::WorkerStats ParallelRenderer::forEachTask(const std::vector<RenderTask>& tasks, const RenderConfig& cfg,
+                                                            const std::function<void(const RenderTask&)>& work,
+                                                            ThreadPool& pool) {
+    auto taskQueue = QueueFactory::createQueue(cfg.queueType, cfg.numThreads, tasks.size());
+
+    for (auto& t : tasks) {
+        taskQueue->push(t);
+    }
+    // Every task is queued before the workers start
+    taskQueue->finish();
+
+    // Idle time is whatever part of the job a worker did not spend inside work
+    using Clock = std::chrono::steady_clock;
+    std::vector<double> busy(std::max(cfg.numThreads, 1), 0.0);
+    std::atomic<int> tasksRun{0};
+    auto start = Clock::now();
+
+    if (cfg.pinThreads) {
+        const CpuTopology& topology = CpuTopology::system();
+        std::vector<int> nodes;
+        for (int cpu : topology.placement(cfg.numThreads)) nodes.push_back(topology.nodeOf(cpu));
+        taskQueue->setWorkerNodes(nodes);
+    }
+
+    forEachWorker(cfg, [&](int i) {
+        RenderTask task(0, 0, 0, 0);
+
+        while (taskQueue->pop(task, i)) {
+            auto taskStart = Clock::now();
+            work(task);
+            busy[i] += std::chrono::duration<double>(Clock::now() - taskStart).count();
+            tasksRun++;
+        }
+    }, pool);
+
+    double total = std::chrono::duration<double>(Clock::now() - start).count();
+    WorkerStats stats;
+    stats.tasksRun = tasksRun;
+    for (double b : busy) stats.idleTime.push_back(std::max(0.0, total - b));
+    return stats;
+}
+
+void ParallelRenderer::forEachWorker(const RenderConfig& cfg, const std::function<void(int)>& work, ThreadPool& pool) {
+    std::vector<int> cpus;
+    if (cfg.pinThreads) cpus = CpuTopology::system().placement(cfg.numThreads);
+
+    pool.run(cfg.numThreads, [&](int i) {
+        // Pool threads run other jobs afterwards, so the pin only lasts for this one
+        std::optional<ScopedAffinity> pin;
+        if (!cpus.empty()) pin.emplace(cpus[i]);
+        work(i);
+    });
+}
+
 // Updated signature: drop explicit algorithm parameter
 Image ParallelRenderer::runParallel(
     const PinholeCamera& camera,
@@ -158,85 +588,150 @@ Image ParallelRenderer::runParallel(
 
     auto tasks = TaskGenerator::generateTasks(width, height, cfg);
 
-    std::vector<RGB> pixels(width * height);
-    auto taskQueue = QueueFactory::createQueue(cfg.queueType);
-
-    for (auto& t : tasks) {
-        taskQueue->push(t);
-    }
-
-    // Pick strategy from cfg.algorithm
-    auto strategy = StrategyFactory::createStrategy(cfg.algorithm);
-
-    std::vector<std::thread> workers;
-
-    for (int i = 0; i < cfg.numThreads; ++i) {
-        workers.emplace_back([&, width, height]() {
-            RenderTask task(0, 0, 0, 0);
-
-            while (taskQueue->pop(task)) {
+    const size_t numPixels = size_t(width) * height;
+    std::vector<RGB> pixels(numPixels);
+    RGB* frame = pixels.data();
+    // Only the work-stealing queue says in advance which worker renders which tile; with
+    // the other queues any worker may get any tile and the pages stay where they are
+    if (cfg.pinThreads && cfg.queueType == QueueType::WORK_STEALING
+        && releasePages(frame, numPixels * sizeof(RGB))) {
+        // Pages go to the node of the thread that touches them first: the zeroed pages are
+        // given back and each pinned worker clears the pixels of the tasks the queue starts
+        // it with. The image then keeps these pages, it is not copied
+        const size_t numTasks = tasks.size(), numWorkers = size_t(std::max(cfg.numThreads, 1));
+        forEachWorker(cfg, [&](int w) {
+            for (size_t t = w * numTasks / numWorkers; t < (w + 1) * numTasks / numWorkers; ++t) {
+                const RenderTask& task = tasks[t];
                 for (int y = task.startY; y < task.endY; ++y) {
-                    float ny = float(y) - (height / 2.0f);
-
-                    for (int x = task.startX; x < task.endX; ++x) {
-                        float nx = float(x) - (width / 2.0f);
-
-                        pixels[y * width + x] = strategy->calculatePixelColor(
-                            camera, scene, nx, ny, samplesPerPixel, cfg
-                        );
-                    }
+                    std::fill(frame + size_t(y) * width + task.startX, frame + size_t(y) * width + task.endX, RGB());
                 }
             }
-        });
+        }, *pool_);
     }
 
-    static_cast<StandardTaskQueue*>(taskQueue.get())->finish();
+    // Pick strategy from cfg.algorithm
+    auto strategy = StrategyFactory::createStrategy(cfg.algorithm);
 
-    for (auto& w : workers) {
-        w.join();
-    }
+    // Each worker renders into its own tile buffer and only touches the framebuffer
+    // to copy a finished tile
+    std::atomic<size_t> pixelsDone{0};
+    WorkerStats workers = forEachTask(tasks, cfg, [&](const RenderTask& task) {
+        thread_local TileBuffer tile;
+        TileView view = tile.reset(task);
+        strategy->calculateTileColors(camera, scene, task.startX, task.startY,
+                                      task.endX, task.endY, samplesPerPixel, cfg, view);
+        tile.commit(frame, width);
+
+        size_t done = pixelsDone += size_t(task.endX - task.startX) * (task.endY - task.startY);
+        if (tileHook_) tileHook_(task, view, done, numPixels);
+    }, *pool_);
 
     auto endTime = std::chrono::high_resolution_clock::now();
     auto dur = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
 
     lastStats_ = {
         dur.count() / 1000.0,
-        int(tasks.size()),
+        workers.tasksRun,
         cfg.numThreads,
         cfg.regionType,
-        cfg.regionSize
+        cfg.regionSize,
+        std::move(workers.idleTime)
     };
 
-    return Image(width, height, pixels);
+    return Image(width, height, std::move(pixels));
 }
 
 /**
  * RenderBenchmark Implementation
  */
+namespace {
+    // Last level cache misses of this thread and of the threads it starts from now on.
+    // Those threads add their count when they exit. Reads -1 where perf events are
+    // not available (containers, VMs without PMU, perf_event_paranoid)
+    class CacheMissCounter {
+    public:
+        CacheMissCounter() {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fd_ = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+        ~CacheMissCounter() { if (fd_ >= 0) close(fd_); }
+
+        long long read() const {
+            long long value;
+            if (fd_ < 0 || ::read(fd_, &value, sizeof(value)) != sizeof(value)) return -1;
+            return value;
+        }
+
+    private:
+        int fd_;
+    };
+
+    const char* regionTypeName(RegionType type) {
+        switch (type) {
+            case RegionType::PIXEL: return "PIXEL";
+            case RegionType::LINE: return "LINE";
+            case RegionType::COLUMN: return "COLUMN";
+            case RegionType::RECTANGLE: return "RECTANGLE";
+            case RegionType::HILBERT: return "HILBERT";
+            case RegionType::MORTON: return "MORTON";
+            case RegionType::SPIRAL: return "SPIRAL";
+        }
+        return "UNKNOWN";
+    }
+
+    const char* queueTypeName(QueueType type) {
+        switch (type) {
+            case QueueType::STD_QUEUE: return "STD";
+            case QueueType::LOCK_FREE_QUEUE: return "LOCK_FREE";
+            case QueueType::WORK_STEALING: return "WORK_STEALING";
+            case QueueType::GUIDED: return "GUIDED";
+        }
+        return "UNKNOWN";
+    }
+}
+
 void RenderBenchmark::benchmarkConfigurations(const PinholeCamera& camera, const Scene& scene,
                                              const std::vector<RenderConfig>& configs,
                                              unsigned samplesPerPixel) {
     std::cout << "=== Parallel Rendering Benchmark ===\n";
-    std::cout << "Configuration\t\tTime(s)\t\tTasks\t\tThreads\n";
-    std::cout << "-------------------------------------------------------\n";
+    std::cout << "Configuration\t\tQueue\t\tTime(s)\t\tTasks\t\tThreads\t\tIdle(s)\t\tCache misses\n";
+    std::cout << "-------------------------------------------------------------------------------------------------------\n";
     for (const auto& cfg : configs) {
-        ParallelRenderer renderer(cfg);
-        auto startTime = std::chrono::high_resolution_clock::now();
-        renderer.render(camera, scene, samplesPerPixel, cfg);
-        auto endTime = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
-        auto stats = renderer.getLastRenderStats();
-        std::string regionName;
-        switch (cfg.regionType) {
-            case RegionType::PIXEL: regionName = "PIXEL"; break;
-            case RegionType::LINE: regionName = "LINE"; break;
-            case RegionType::COLUMN: regionName = "COLUMN"; break;
-            case RegionType::RECTANGLE: regionName = "RECTANGLE"; break;
+        ParallelRenderer::RenderStats stats;
+        long long cacheMisses;
+        std::chrono::milliseconds duration;
+        {
+            // The counter has to exist before the pool threads so that they inherit it,
+            // and is read once they have exited
+            CacheMissCounter counter;
+            std::optional<ThreadPool> pool(std::in_place, cfg.numThreads);
+            ParallelRenderer renderer(cfg, &*pool);
+            auto startTime = std::chrono::high_resolution_clock::now();
+            renderer.render(camera, scene, samplesPerPixel, cfg);
+            auto endTime = std::chrono::high_resolution_clock::now();
+            duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
+            stats = renderer.getLastRenderStats();
+            pool.reset();   // Joins the workers, which adds their misses to the counter
+            cacheMisses = counter.read();
         }
-        std::cout << regionName << "(" << cfg.regionSize << ")\t\t"
+        std::cout << regionTypeName(cfg.regionType) << "(" << cfg.regionSize << ")\t\t"
+                  << queueTypeName(cfg.queueType) << "\t\t"
                   << duration.count() / 1000.0 << "\t\t"
                   << stats.numTasks << "\t\t"
-                  << stats.numThreads << "\n";
+                  << stats.numThreads << "\t\t";
+        // Mean over the workers: near zero when they all finish together
+        double idle = 0.0;
+        for (double t : stats.idleTime) idle += t;
+        std::cout << (stats.idleTime.empty() ? 0.0 : idle / stats.idleTime.size()) << "\t\t";
+        if (cacheMisses >= 0) std::cout << cacheMisses << "\n";
+        else std::cout << "n/a\n";
     }
 }
 
@@ -269,3 +764,101 @@ RenderConfig RenderBenchmark::findOptimalConfig(const PinholeCamera& camera, con
     }
     return bestConfig;
 }
+
+void RenderBenchmark::benchmarkQueues(int width, int height, const std::vector<int>& threadCounts,
+                                      int repetitions) {
+    RenderConfig pixelConfig;
+    pixelConfig.regionType = RegionType::PIXEL;
+    auto tasks = TaskGenerator::generateTasks(width, height, pixelConfig);
+    const QueueType types[] = {QueueType::STD_QUEUE, QueueType::LOCK_FREE_QUEUE, QueueType::WORK_STEALING};
+
+    std::cout << "=== Task Queue Contention Benchmark (" << tasks.size() << " PIXEL tasks) ===\n";
+    std::cout << "Threads";
+    for (QueueType type : types) std::cout << "\t" << queueTypeName(type) << "(ms)";
+    std::cout << "\n";
+
+    for (int numThreads : threadCounts) {
+        std::cout << numThreads;
+        for (QueueType type : types) {
+            double best = std::numeric_limits<double>::max();
+            for (int rep = 0; rep < repetitions; ++rep) {
+                auto queue = QueueFactory::createQueue(type, numThreads, tasks.size());
+                for (const auto& t : tasks) queue->push(t);
+                queue->finish();
+
+                std::atomic<long> checksum{0};
+                auto startTime = std::chrono::high_resolution_clock::now();
+                std::vector<std::thread> workers;
+                for (int i = 0; i < numThreads; ++i) {
+                    workers.emplace_back([&, i]() {
+                        RenderTask task;
+                        long local = 0;
+                        while (queue->pop(task, i)) local += task.taskId;
+                        checksum += local;
+                    });
+                }
+                for (auto& w : workers) w.join();
+                auto endTime = std::chrono::high_resolution_clock::now();
+                best = std::min(best, std::chrono::duration<double, std::milli>(endTime - startTime).count());
+            }
+            std::cout << "\t" << best;
+        }
+        std::cout << "\n";
+    }
+}
+
+void RenderBenchmark::benchmarkThreadPool(int numThreads, int jobs) {
+    std::atomic<long> counter{0};
+    auto work = [&](int i) { counter += i; };
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    for (int job = 0; job < jobs; ++job) {
+        std::vector<std::thread> workers;
+        for (int i = 0; i < numThreads; ++i) workers.emplace_back(work, i);
+        for (auto& w : workers) w.join();
+    }
+    auto midTime = std::chrono::high_resolution_clock::now();
+
+    ThreadPool pool(numThreads);
+    for (int job = 0; job < jobs; ++job) pool.run(numThreads, work);
+    auto endTime = std::chrono::high_resolution_clock::now();
+
+    std::cout << "=== Thread Pool Benchmark (" << jobs << " jobs, " << numThreads << " threads) ===\n";
+    std::cout << "Create/join threads:\t" << std::chrono::duration<double, std::micro>(midTime - startTime).count() / jobs
+              << " us per job\n";
+    std::cout << "Persistent pool:\t" << std::chrono::duration<double, std::micro>(endTime - midTime).count() / jobs
+              << " us per job\n";
+}
+
+void RenderBenchmark::benchmarkScaling(const PinholeCamera& camera, const Scene& scene,
+                                       unsigned samplesPerPixel) {
+    const CpuTopology& topology = CpuTopology::system();
+    const int maxThreads = int(topology.cpus.size());
+
+    std::cout << "=== Scaling Benchmark (" << maxThreads << " CPUs, " << topology.numNodes << " NUMA nodes) ===\n";
+    std::cout << "Threads\tFree(s)\tSpeedup\tPinned(s)\tSpeedup\n";
+
+    std::vector<int> counts;
+    for (int n = 1; n < maxThreads; n *= 2) counts.push_back(n);
+    counts.push_back(maxThreads);
+
+    double base[2] = {0.0, 0.0};
+    for (int n : counts) {
+        std::cout << n;
+        for (int pinned = 0; pinned < 2; ++pinned) {
+            RenderConfig cfg;
+            cfg.regionType = RegionType::RECTANGLE;
+            cfg.regionSize = 16;
+            cfg.queueType = QueueType::WORK_STEALING;
+            cfg.numThreads = n;
+            cfg.pinThreads = pinned;
+            ParallelRenderer renderer(cfg);
+            auto startTime = std::chrono::high_resolution_clock::now();
+            renderer.render(camera, scene, samplesPerPixel, cfg);
+            double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+            if (n == 1) base[pinned] = seconds;
+            std::cout << "\t" << seconds << "\t" << base[pinned] / seconds << "x";
+        }
+        std::cout << "\n";
+    }
+}
@@ -4,11 +4,13 @@
 #include "../include/parallel_renderer.hpp"
 #include "../include/rendering_strategy.hpp"
 #include "../include/utils.hpp"
+#include "../include/adaptive_sampler.hpp"
 #include "constants.hpp"
 #include <vector>
 #include <fstream>
 #include <random>
 #include <cmath>
+#include <algorithm>
 
 /********************
  * Métodos Públicos *
@@ -32,22 +34,51 @@ Image PinholeCamera::render(const Scene& scene, unsigned samplesPerPixel,
                            const RenderConfig& config) const {
     auto strategy = StrategyFactory::createStrategy(config.algorithm);
     if (config.mode == RenderingMode::PARALLEL) {
+        // ParallelRenderer also handles adaptive sampling
         ParallelRenderer renderer(config);
         return renderer.render(*this, scene, samplesPerPixel, config);
+    } else if (config.adaptiveSampling) {
+        AdaptiveSampler::Result result = AdaptiveSampler::render(*this, scene, samplesPerPixel, config);
+        if (!config.heatmapPath.empty()) result.heatmap.writePPM(config.heatmapPath);
+        return std::move(result.image);
     } else {
         std::vector<RGB> pixels(height * width);
-        for (int y = 0; y < height; y++) {
-            float normalizedY = static_cast<float>(y) - (height / 2.0f);
-            for (int x = 0; x < width; x++) {
-                float normalizedX = static_cast<float>(x) - (width / 2.0f);
-                RGB pixelColor = strategy->calculatePixelColor(*this, scene, normalizedX, normalizedY, samplesPerPixel, config);
-                pixels[y * width + x] = pixelColor;
-            }
-        }
+        strategy->calculateTileColors(*this, scene, 0, 0, width, height, samplesPerPixel, config,
+                                      TileView::wholeImage(pixels, width));
         return Image(width, height, pixels);
     }
 }
 
+Image PinholeCamera::renderProgressivePhotonMapping(const Scene& scene, unsigned samples, unsigned passes,
+                                                   int pathsPerPass, const RenderConfig& config, double alpha) const {
+    RenderConfig pass = config;
+    pass.algorithm = RenderingAlgorithm::PHOTON_MAPPING;
+    // Sin máximo de fotones: la estimación usa el radio de la pasada, así reducirlo
+    // reduce el sesgo. Con k vecinos el radio real sería el del k-ésimo
+    pass.kPhotons = 0;
+    pass.kCaustic = 0;
+    std::vector<RGB> sum(width * height);
+
+    for (unsigned i = 0; i < passes; i++) {
+        // Fotones y muestras de cámara nuevos en cada pasada
+        pass.seed = PCG32::mix(config.seed + i);
+        MapasFotones mapas = scene.generarMapasFotones(pathsPerPass, 0.0, pass.seed,
+                                                        std::thread::hardware_concurrency(), pass.sampler);
+        pass.photonMap = &mapas.global;
+        pass.causticMap = &mapas.causticos;
+
+        Image image = render(scene, samples, pass);
+        for (size_t p = 0; p < sum.size(); p++) sum[p] += image.pixels[p];
+
+        double reduction = std::sqrt((i + alpha) / (i + 1));
+        pass.radius *= reduction;
+        pass.causticRadius *= reduction;
+    }
+
+    for (RGB& pixel : sum) pixel = pixel / float(std::max(passes, 1u));
+    return Image(width, height, sum);
+}
+
 Ray PinholeCamera::generateRay(float x, float y) const {
     // Calculate the direction of the ray
     Direction direction = (left * x + up * y + forward);
@@ -56,8 +87,10 @@ Ray PinholeCamera::generateRay(float x, float y) const {
 
 RGB PinholeCamera::traceRay(const Ray& ray, const Scene& scene) const {
     // Find the closest intersection of the ray with the scene
-    auto intersection = scene.intersect(ray);
+    return shadeHit(ray, scene.intersect(ray), scene);
+}
 
+RGB PinholeCamera::shadeHit(const Ray&, const std::optional<Intersection>& intersection, const Scene& scene) const {
     // Return the color of the intersected material, or black if no intersection
     RGB color = RGB(0, 0, 0);
     if (intersection) {
@@ -66,7 +99,7 @@ RGB PinholeCamera::traceRay(const Ray& ray, const Scene& scene) const {
 
         // Si no hay luces en la escena, devolvemos el color del material
         if (lightAmount == 0) {
-            return intersection->material.diffuse;
+            return intersection->material->diffuse;
         }
 
         // Iteramos por cada una de las luces de la escena
@@ -78,15 +111,13 @@ RGB PinholeCamera::traceRay(const Ray& ray, const Scene& scene) const {
             Direction obstructionDirection = (currentLight->center - intersection->point); // Dirección desde el punto de intersección hasta la luz
             float obstructionDistance = obstructionDirection.mod(); // Evitamos colisiones con otros objetos más lejanos que la luz
             Ray obstructionRay(intersection->point * (1+EPSILON), obstructionDirection); // Creamos el raycast para comprobar la colisión
-            auto obstruction = scene.intersect(obstructionRay, obstructionDistance);
-
-            if (obstruction) {
+            if (scene.occluded(obstructionRay, obstructionDistance)) {
                 continue;
             }
 
             RGB powerByDistance = currentLight->light / pow(Direction(currentLight->center - intersection->point).mod(), 2);
 
-            RGB brdf = intersection->material.diffuse * (1.0f / M_PI); // Lambertian reflectance
+            RGB brdf = intersection->material->diffuse * (1.0f / M_PI); // Lambertian reflectance
 
             Direction lightDirection = (currentLight->center - intersection->point).normalize();
             Direction normal = intersection->normal.normalize();
@@ -106,9 +137,11 @@ RGB PinholeCamera::traceRay(const Ray& ray, const Scene& scene) const {
  * This is used for path tracing to sample directions uniformly.
  */
 // https://the-last-stand.github.io/ray-tracing-practice/the_rest_of_your_life/generating_random_directions/
-Direction randomCosineDirection(const Direction& normal) {
-    float r1 = 2 * M_PI * rand0_1();
-    float r2 = rand0_1();
+Direction randomCosineDirection(const Direction& normal, Sampler& rng) {
+    double xi1, xi2;
+    rng.next2D(xi1, xi2);
+    float r1 = 2 * M_PI * xi1;
+    float r2 = xi2;
     float r2s = sqrt(r2);
 
     // Base ortonormal
@@ -120,7 +153,7 @@ Direction randomCosineDirection(const Direction& normal) {
     return (u * cos(r1) * r2s + v * sin(r1) * r2s + w * sqrt(1 - r2)).normalize();
 }
 
-RGB PinholeCamera::tracePath(const Ray& ray, const Scene& scene, unsigned depth) const {
+RGB PinholeCamera::tracePath(const Ray& ray, const Scene& scene, Sampler& rng, unsigned depth) const {
     
     if (depth > 20) { // Caso base: Máximo número de rebotes
         return RGB(0, 0, 0);
@@ -134,56 +167,119 @@ RGB PinholeCamera::tracePath(const Ray& ray, const Scene& scene, unsigned depth)
     }
 
     // Si el material es emisivo, devolvemos su color (como una fuente de luz)
-    if (intersection->material.isEmissive) {
-        return intersection->material.diffuse;
+    if (intersection->material->isEmissive) {
+        return intersection->material->diffuse;
     }
 
     // Cálculo de la luz directa
     RGB directLight(0, 0, 0);
     RGB indirectLight(1, 1, 1);
-    float diffuse = intersection->material.diffuse.max();
-    float specular = intersection->material.specular.max();
+    float diffuse = intersection->material->diffuse.max();
+    float specular = intersection->material->specular.max();
 
     if (diffuse + specular > 0.9f) {
         diffuse = 0.9f * diffuse / (diffuse + specular);
         specular = 0.9f * specular / (diffuse + specular);
     }
 
-    float randomValue = rand0_1();
+    float randomValue = rand0_1(rng);
     if (randomValue < diffuse) {
         // Si el valor aleatorio es menor que la probabilidad de difuso, devolvemos la luz directa
         directLight = scene.calculateDirectLight(intersection->point);
-        indirectLight = indirectLight * (intersection->material.diffuse / diffuse); // Difuso
+        indirectLight = indirectLight * (intersection->material->diffuse / diffuse); // Difuso
     } else if (randomValue < diffuse + specular) {
         // Si el valor aleatorio está entre la probabilidad de difuso y especular, devolvemos el color especular
         
         // TODO: No se para que se usa esta variable
         Direction wr = (ray.direction - intersection->normal * 2 * ray.direction.dot(intersection->normal)).normalize();
         (void)wr; // Suppress unused variable warning
-        indirectLight = indirectLight * (intersection->material.specular / specular); // Especular
+        indirectLight = indirectLight * (intersection->material->specular / specular); // Especular
     } else {
         return scene.backgroundColor; // Matamos el rayo
     }
 
     // Rebote indirecto: dirección aleatoria en el hemisferio de la normal
-    Direction randomDir = randomCosineDirection(intersection->normal);
+    Direction randomDir = randomCosineDirection(intersection->normal, rng);
     Ray randomRay(intersection->point + randomDir * EPSILON, randomDir);
 
     // Ruleta rusa para terminar caminos largos
-    float survivalProbability = std::min(0.9f, intersection->material.diffuse.max());
-    if (depth >= 3 && rand0_1() > survivalProbability) {
+    float survivalProbability = std::min(0.9f, intersection->material->diffuse.max());
+    if (depth >= 3 && rand0_1(rng) > survivalProbability) {
         return directLight;
     }
 
     // Recursión para el rebote indirecto
-    RGB reflectedColor = tracePath(randomRay, scene, depth + 1);
+    RGB reflectedColor = tracePath(randomRay, scene, rng, depth + 1);
     if (depth >= 3) {
         reflectedColor = reflectedColor / survivalProbability;
     }
 
     float cosTheta = std::max(0.0f, intersection->normal.dot(randomDir));
-    RGB brdf = intersection->material.diffuse * (1.0f / M_PI);
+    RGB brdf = intersection->material->diffuse * (1.0f / M_PI);
 
     // Suma de luz directa e indirecta
     return directLight * brdf * cosTheta + reflectedColor;
 }
+
+/*
+ * Iterative version of tracePath. Instead of recursing, the path carries its
+ * radiance and throughput in a PathState and the loop advances it one bounce at a
+ * time, so only one intersection record is alive at any point. It consumes the
+ * random numbers in the same order as tracePath and has the same expected value.
+ */
+RGB PinholeCamera::tracePathIterative(const Ray& ray, const Scene& scene, Sampler& rng,
+                                      const RenderConfig& config) const {
+    PathState path{ray, RGB(0, 0, 0), RGB(1, 1, 1), 0};
+
+    while (path.depth <= config.maxDepth) {
+        std::optional<Intersection> intersection = scene.intersect(path.ray);
+        if (!intersection) {
+            path.radiance += path.throughput * scene.backgroundColor;
+            break;
+        }
+
+        const Material& material = *intersection->material;
+        if (material.isEmissive) {
+            path.radiance += path.throughput * material.diffuse;
+            break;
+        }
+
+        float diffuse = material.diffuse.max();
+        float specular = material.specular.max();
+        if (diffuse + specular > 0.9f) {
+            diffuse = 0.9f * diffuse / (diffuse + specular);
+            specular = 0.9f * specular / (diffuse + specular);
+        }
+
+        RGB directLight(0, 0, 0);
+        float randomValue = rand0_1(rng);
+        if (randomValue < diffuse) {
+            directLight = scene.calculateDirectLight(intersection->point);
+        } else if (randomValue >= diffuse + specular) {
+            path.radiance += path.throughput * scene.backgroundColor; // Rayo absorbido
+            break;
+        }
+
+        Direction randomDir = randomCosineDirection(intersection->normal, rng);
+
+        // Ruleta rusa a partir de russianRouletteDepth rebotes
+        float survivalProbability = std::min(0.9f, material.diffuse.max());
+        bool roulette = path.depth >= config.russianRouletteDepth;
+        if (roulette && rand0_1(rng) > survivalProbability) {
+            path.radiance += path.throughput * directLight;
+            break;
+        }
+
+        float cosTheta = std::max(0.0f, intersection->normal.dot(randomDir));
+        RGB brdf = material.diffuse * (1.0f / M_PI);
+        path.radiance += path.throughput * directLight * brdf * cosTheta;
+
+        if (roulette) {
+            path.throughput = path.throughput / survivalProbability;
+        }
+        path.ray = Ray(intersection->point + randomDir * EPSILON, randomDir);
+        path.depth++;
+    }
+
+    return path.radiance;
+}
\ No newline at end of file
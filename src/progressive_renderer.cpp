@@ -0,0 +1,171 @@
+#include "../include/progressive_renderer.hpp"
+#include "../include/parallel_renderer.hpp"
+#include "../include/pinholeCamera.hpp"
+#include "../include/rendering_strategy.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+    constexpr char MAGIC[4] = {'A', 'C', 'C', '2'};
+
+    template <typename T>
+    void writeValue(std::ofstream& file, const T& value) {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    bool readValue(std::ifstream& file, T& value) {
+        return bool(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+    }
+}
+
+/**********************
+ * AccumulationBuffer *
+ **********************/
+
+AccumulationBuffer::AccumulationBuffer(int width, int height, const RenderConfig& config)
+    : width(width), height(height), seed(config.seed), algorithm(config.algorithm), sampler(config.sampler),
+      maxDepth(config.maxDepth), russianRouletteDepth(config.russianRouletteDepth),
+      sum(size_t(width) * height), counts(size_t(width) * height, 0) {}
+
+Image AccumulationBuffer::image() const {
+    std::vector<RGB> pixels(sum.size());
+    for (size_t p = 0; p < sum.size(); p++) {
+        if (counts[p] > 0) pixels[p] = sum[p] / float(counts[p]);
+    }
+    return Image(width, height, std::move(pixels));
+}
+
+bool AccumulationBuffer::matches(int w, int h, const RenderConfig& config, unsigned spp) const noexcept {
+    return width == w && height == h && seed == config.seed && algorithm == config.algorithm &&
+           sampler == config.sampler && maxDepth == config.maxDepth &&
+           russianRouletteDepth == config.russianRouletteDepth && samplesPerPass == spp;
+}
+
+bool AccumulationBuffer::save(const std::string& path) const noexcept {
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Error opening path " + tmp << std::endl;
+            return false;
+        }
+        file.write(MAGIC, sizeof(MAGIC));
+        writeValue(file, int32_t(width));
+        writeValue(file, int32_t(height));
+        writeValue(file, seed);
+        writeValue(file, int32_t(algorithm));
+        writeValue(file, int32_t(sampler));
+        writeValue(file, uint32_t(maxDepth));
+        writeValue(file, uint32_t(russianRouletteDepth));
+        writeValue(file, uint32_t(samplesPerPass));
+        writeValue(file, uint32_t(passes));
+        file.write(reinterpret_cast<const char*>(sum.data()), sum.size() * sizeof(RGB));
+        file.write(reinterpret_cast<const char*>(counts.data()), counts.size() * sizeof(uint32_t));
+        if (!file) {
+            std::cerr << "Error writing checkpoint " + tmp << std::endl;
+            return false;
+        }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::cerr << "Error renaming " + tmp + " to " + path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::optional<AccumulationBuffer> AccumulationBuffer::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return std::nullopt;
+
+    char magic[sizeof(MAGIC)];
+    int32_t width, height, algorithm, sampler;
+    uint32_t maxDepth, russianRouletteDepth, samplesPerPass, passes;
+    AccumulationBuffer buffer;
+    if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        !readValue(file, width) || !readValue(file, height) || !readValue(file, buffer.seed) ||
+        !readValue(file, algorithm) || !readValue(file, sampler) || !readValue(file, maxDepth) ||
+        !readValue(file, russianRouletteDepth) || !readValue(file, samplesPerPass) ||
+        !readValue(file, passes) || width <= 0 || height <= 0) {
+        std::cerr << "Error: " << path << " is not a checkpoint" << std::endl;
+        return std::nullopt;
+    }
+
+    buffer.width = width;
+    buffer.height = height;
+    buffer.algorithm = RenderingAlgorithm(algorithm);
+    buffer.sampler = SamplerType(sampler);
+    buffer.maxDepth = maxDepth;
+    buffer.russianRouletteDepth = russianRouletteDepth;
+    buffer.samplesPerPass = samplesPerPass;
+    buffer.passes = passes;
+    buffer.sum.resize(size_t(width) * height);
+    buffer.counts.resize(size_t(width) * height);
+    if (!file.read(reinterpret_cast<char*>(buffer.sum.data()), buffer.sum.size() * sizeof(RGB)) ||
+        !file.read(reinterpret_cast<char*>(buffer.counts.data()), buffer.counts.size() * sizeof(uint32_t))) {
+        std::cerr << "Error: checkpoint " << path << " is truncated" << std::endl;
+        return std::nullopt;
+    }
+    return buffer;
+}
+
+/***********************
+ * ProgressiveRenderer *
+ ***********************/
+
+ProgressiveRenderer::ProgressiveRenderer(const PinholeCamera& camera, const Scene& scene, const RenderConfig& config)
+    : camera_(camera), scene_(scene), config_(config),
+      buffer_(camera.getWidth(), camera.getHeight(), config) {}
+
+Image ProgressiveRenderer::render(const Settings& settings) {
+    if (!settings.checkpointPath.empty()) {
+        auto checkpoint = AccumulationBuffer::load(settings.checkpointPath);
+        if (checkpoint && checkpoint->matches(camera_.getWidth(), camera_.getHeight(), config_, settings.samplesPerPass)) {
+            buffer_ = std::move(*checkpoint);
+            std::cout << "Resuming from " << settings.checkpointPath << " after "
+                      << buffer_.passes << " passes" << std::endl;
+        } else if (checkpoint) {
+            std::cerr << "Checkpoint " << settings.checkpointPath
+                      << " is from another render, starting again" << std::endl;
+        }
+    }
+
+    while (buffer_.passes < settings.passes) {
+        renderPass(settings.samplesPerPass);
+        if (!settings.previewPath.empty()) buffer_.image().writePPM(settings.previewPath);
+        if (!settings.checkpointPath.empty()) buffer_.save(settings.checkpointPath);
+    }
+    return buffer_.image();
+}
+
+void ProgressiveRenderer::renderPass(unsigned samplesPerPass) {
+    const int width = camera_.getWidth(), height = camera_.getHeight();
+    auto strategy = StrategyFactory::createStrategy(config_.algorithm);
+    auto tasks = TaskGenerator::generateTasks(width, height, config_);
+
+    auto renderTask = [&](const RenderTask& task) {
+        for (int y = task.startY; y < task.endY; ++y) {
+            float ny = float(y) - (height / 2.0f);
+            for (int x = task.startX; x < task.endX; ++x) {
+                float nx = float(x) - (width / 2.0f);
+                size_t p = size_t(y) * width + x;
+                uint32_t first = buffer_.counts[p];
+                for (uint32_t i = first; i < first + samplesPerPass; i++) {
+                    buffer_.sum[p] += strategy->sampleColor(camera_, scene_, nx, ny, i, config_);
+                }
+                buffer_.counts[p] = first + samplesPerPass;
+            }
+        }
+    };
+
+    if (config_.mode == RenderingMode::PARALLEL) {
+        ParallelRenderer::forEachTask(tasks, config_, renderTask);
+    } else {
+        for (const auto& task : tasks) renderTask(task);
+    }
+    buffer_.samplesPerPass = samplesPerPass;
+    buffer_.passes++;
+}
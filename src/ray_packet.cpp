@@ -0,0 +1,242 @@
+#include "../include/ray_packet.hpp"
+#include "../include/object3D.hpp"
+#include "../include/simd.hpp"
+#include "constants.hpp"
+
+#include <bit>
+
+using namespace std;
+
+namespace {
+    // Calls f(g, lanes) for every group of simd::WIDTH rays starting at ray g that has
+    // an active ray; lanes is the mask of the active rays of the group, bit 0 being ray g
+    template <typename GroupFunc>
+    void forEachGroup(uint64_t active, GroupFunc f) {
+        const uint64_t groupMask = (uint64_t(1) << simd::WIDTH) - 1;
+        for (int g = 0; g < RayPacket::MAX_RAYS && (active >> g) != 0; g += simd::WIDTH) {
+            uint64_t lanes = (active >> g) & groupMask;
+            if (lanes != 0) f(g, lanes);
+        }
+    }
+
+    // Rays of 'active' that enter the node before their closest hit so far. Same
+    // slab test as BoxRay::hits, simd::WIDTH rays at a time
+    uint64_t enteringRays(const BVHNode& node, const RayPacket& p, const PacketHits& hits, uint64_t active) {
+        using namespace simd;
+        const float* origin[3] = {p.ox, p.oy, p.oz};
+        const float* invDir[3] = {p.invDx, p.invDy, p.invDz};
+        const V zero = set1(0.0f);
+
+        uint64_t entering = 0;
+        forEachGroup(active, [&](int g, uint64_t lanes) {
+            V tmin = zero, tmax = load(hits.distance + g);
+            for (int k = 0; k < 3; k++) {
+                V o = load(origin[k] + g), inv = load(invDir[k] + g);
+                V t0 = mul(sub(set1(node.bmin[k]), o), inv);
+                V t1 = mul(sub(set1(node.bmax[k]), o), inv);
+                M negative = lt(inv, zero);
+                V tnear = select(negative, t1, t0), tfar = select(negative, t0, t1);
+                tmin = select(gt(tnear, tmin), tnear, tmin);
+                tmax = select(lt(tfar, tmax), tfar, tmax);
+            }
+            entering |= (uint64_t(bits(le(tmin, tmax))) & lanes) << g;
+        });
+        return entering;
+    }
+
+    void clearElements(uint64_t hits, uint32_t* element) {
+        for (; hits != 0; hits &= hits - 1) element[countr_zero(hits)] = 0;
+    }
+}
+
+/*************
+ * RayPacket *
+ *************/
+
+RayPacket::RayPacket(const Ray* rays, int count) : count(count < MAX_RAYS ? count : MAX_RAYS), rays(rays) {
+    for (int i = 0; i < MAX_RAYS; i++) {
+        bool used = i < this->count;
+        ox[i] = used ? rays[i].origin.x : 0.0f;
+        oy[i] = used ? rays[i].origin.y : 0.0f;
+        oz[i] = used ? rays[i].origin.z : 0.0f;
+        dx[i] = used ? rays[i].direction.x : 0.0f;
+        dy[i] = used ? rays[i].direction.y : 0.0f;
+        dz[i] = used ? rays[i].direction.z : 0.0f;
+        invDx[i] = 1.0f / dx[i];
+        invDy[i] = 1.0f / dy[i];
+        invDz[i] = 1.0f / dz[i];
+    }
+}
+
+/************
+ * Object3D *
+ ************/
+
+uint64_t Object3D::hitPacket(const RayPacket& packet, uint64_t active, float* t, uint32_t* element) const {
+    uint64_t hits = 0;
+    for (; active != 0; active &= active - 1) {
+        int i = countr_zero(active);
+        auto distance = hitElement(packet.rays[i], element[i]);
+        if (distance) {
+            t[i] = *distance;
+            hits |= uint64_t(1) << i;
+        }
+    }
+    return hits;
+}
+
+/*
+ * The kernels below repeat the operations of the scalar hitDistance in the same
+ * order, so a ray gets exactly the same distance alone or inside a packet.
+ */
+
+/**********
+ * Sphere *
+ **********/
+
+uint64_t Sphere::hitPacket(const RayPacket& p, uint64_t active, float* t, uint32_t* element) const {
+    using namespace simd;
+    const V zero = set1(0.0f), r2 = set1(radius * radius);
+    const V cx = set1(center.x), cy = set1(center.y), cz = set1(center.z);
+
+    uint64_t hits = 0;
+    forEachGroup(active, [&](int g, uint64_t lanes) {
+        V ocx = sub(cx, load(p.ox + g)), ocy = sub(cy, load(p.oy + g)), ocz = sub(cz, load(p.oz + g));
+        V tca = dot(ocx, ocy, ocz, load(p.dx + g), load(p.dy + g), load(p.dz + g));
+        V d2 = sub(dot(ocx, ocy, ocz, ocx, ocy, ocz), mul(tca, tca));
+
+        // Lanes with d2 > r2 get NaN here, they are masked out below
+        V thc = simd::sqrt(sub(r2, d2));
+        V t0 = sub(tca, thc), t1 = add(tca, thc);
+        store(t + g, select(ge(t0, zero), t0, t1));
+
+        M mask = both(ge(tca, zero), le(d2, r2));
+        hits |= (uint64_t(bits(mask)) & lanes) << g;
+    });
+    clearElements(hits, element);
+    return hits;
+}
+
+/*********
+ * Plane *
+ *********/
+
+uint64_t Plane::hitPacket(const RayPacket& p, uint64_t active, float* t, uint32_t* element) const {
+    using namespace simd;
+    const V zero = set1(0.0f), eps = set1(EPSILON);
+    const V nx = set1(normal.x), ny = set1(normal.y), nz = set1(normal.z);
+    Point base = Point(normal.x, normal.y, normal.z) * distance;
+    const V bx = set1(base.x), by = set1(base.y), bz = set1(base.z);
+
+    uint64_t hits = 0;
+    forEachGroup(active, [&](int g, uint64_t lanes) {
+        V denominator = dot(nx, ny, nz, load(p.dx + g), load(p.dy + g), load(p.dz + g));
+        V numerator = dot(nx, ny, nz, sub(bx, load(p.ox + g)), sub(by, load(p.oy + g)), sub(bz, load(p.oz + g)));
+        V dist = div(numerator, denominator);
+        store(t + g, dist);
+
+        M mask = both(ge(simd::abs(denominator), eps), ge(dist, zero));
+        hits |= (uint64_t(bits(mask)) & lanes) << g;
+    });
+    clearElements(hits, element);
+    return hits;
+}
+
+/************
+ * Triangle *
+ ************/
+
+uint64_t Triangle::hitPacket(const RayPacket& p, uint64_t active, float* t, uint32_t* element) const {
+    using namespace simd;
+    const float EPS = 1e-8f;
+    const V zero = set1(0.0f), one = set1(1.0f), eps = set1(EPS);
+    Direction edge1 = b - a, edge2 = c - a;
+    const V e1x = set1(edge1.x), e1y = set1(edge1.y), e1z = set1(edge1.z);
+    const V e2x = set1(edge2.x), e2y = set1(edge2.y), e2z = set1(edge2.z);
+
+    uint64_t hits = 0;
+    forEachGroup(active, [&](int g, uint64_t lanes) {
+        V dx = load(p.dx + g), dy = load(p.dy + g), dz = load(p.dz + g);
+
+        // h = d x e2, det = e1 . h
+        V hx = sub(mul(dy, e2z), mul(dz, e2y));
+        V hy = sub(mul(dz, e2x), mul(dx, e2z));
+        V hz = sub(mul(dx, e2y), mul(dy, e2x));
+        V det = dot(e1x, e1y, e1z, hx, hy, hz);
+        V f = div(one, det);
+
+        // s = o - a, u = f (s . h)
+        V sx = sub(load(p.ox + g), set1(a.x));
+        V sy = sub(load(p.oy + g), set1(a.y));
+        V sz = sub(load(p.oz + g), set1(a.z));
+        V u = mul(f, dot(sx, sy, sz, hx, hy, hz));
+
+        // q = s x e1, v = f (d . q), t = f (e2 . q)
+        V qx = sub(mul(sy, e1z), mul(sz, e1y));
+        V qy = sub(mul(sz, e1x), mul(sx, e1z));
+        V qz = sub(mul(sx, e1y), mul(sy, e1x));
+        V v = mul(f, dot(dx, dy, dz, qx, qy, qz));
+        V dist = mul(f, dot(e2x, e2y, e2z, qx, qy, qz));
+        store(t + g, dist);
+
+        M mask = ge(simd::abs(det), eps);
+        mask = both(mask, both(ge(u, zero), le(u, one)));
+        mask = both(mask, both(ge(v, zero), le(add(u, v), one)));
+        mask = both(mask, gt(dist, eps));
+        hits |= (uint64_t(bits(mask)) & lanes) << g;
+    });
+    clearElements(hits, element);
+    return hits;
+}
+
+/*******
+ * BVH *
+ *******/
+
+void BVH::intersectPacket(const RayPacket& packet, PacketHits& hits) const {
+    alignas(32) float t[RayPacket::MAX_RAYS];
+    uint32_t element[RayPacket::MAX_RAYS];
+
+    auto test = [&](const PrimitiveRef& ref, uint64_t active) {
+        for (uint64_t hit = ref.object->hitPacket(packet, active, t, element); hit != 0; hit &= hit - 1) {
+            int i = countr_zero(hit);
+            hits.record(i, t[i], ref.index, ref.material, element[i]);
+        }
+    };
+
+    for (const auto& ref : unbounded) test(ref, packet.all());
+
+    if (nodes.empty()) return;
+
+    struct Entry {
+        uint32_t node;
+        uint64_t active;    // Rays that entered the parent
+    };
+    Entry stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = {0, packet.all()};
+
+    const float* invDir[3] = {packet.invDx, packet.invDy, packet.invDz};
+
+    while (stackSize > 0) {
+        Entry entry = stack[--stackSize];
+        const BVHNode& node = nodes[entry.node];
+        uint64_t active = enteringRays(node, packet, hits, entry.active);
+        if (active == 0) continue;
+
+        if (node.count > 0) {
+            for (uint32_t i = 0; i < node.count; i++) test(primitives[node.offset + i], active);
+        } else {
+            uint32_t left = entry.node + 1;
+            uint32_t right = node.offset;
+            // Camera rays are coherent: the first active ray decides which child is near
+            if (invDir[node.axis][countr_zero(active)] < 0) {
+                stack[stackSize++] = {left, active};
+                stack[stackSize++] = {right, active};
+            } else {
+                stack[stackSize++] = {right, active};
+                stack[stackSize++] = {left, active};
+            }
+        }
+    }
+}
@@ -1,31 +1,171 @@
 #include "../include/rendering_strategy.hpp"
 #include "../include/pinholeCamera.hpp"
 #include "../include/object3D.hpp"
+#include "../include/ray_packet.hpp"
+#include <algorithm>
 #include <memory>
 
 // Helper for anti-aliased pixel color sampling
 namespace {
+    template<typename PerRayColorFunc>
+    RGB sampleOnce(const PinholeCamera& camera, const Scene& scene,
+                   float x, float y, unsigned sample, const RenderConfig& config,
+                   PerRayColorFunc perRayColor) {
+        // One generator per sample: same image whatever thread renders the pixel
+        Sampler rng = Sampler::forSample(config.sampler, config.seed, x, y, sample);
+        double u, v;
+        rng.next2D(u, v);
+        float x_offset = x + u;
+        float y_offset = y + v;
+        Ray ray = camera.generateRay(x_offset, y_offset);
+        return perRayColor(ray, scene, config, rng);
+    }
+
     template<typename PerRayColorFunc>
     RGB samplePixelColor(const PinholeCamera& camera, const Scene& scene,
                         float x, float y, unsigned samples, const RenderConfig& config,
                         PerRayColorFunc perRayColor) {
         RGB accumulatedColor(0, 0, 0);
         for (unsigned i = 0; i < samples; i++) {
-            float x_offset = x + rand0_1();
-            float y_offset = y + rand0_1();
-            Ray ray = camera.generateRay(x_offset, y_offset);
-            accumulatedColor += perRayColor(ray, scene, config);
+            accumulatedColor += sampleOnce(camera, scene, x, y, i, config, perRayColor);
         }
         return accumulatedColor / samples;
     }
+
+    // Maximum distance of the camera rays, the default of Scene::intersect
+    constexpr float CAMERA_RAY_DISTANCE = 1000.0f;
+
+    // Same samples as samplePixelColor, but the camera rays of every block of
+    // packetSize x packetSize pixels are intersected together. Each ray is shaded
+    // on its own from its first hit on.
+    template<typename ShadeFunc>
+    void samplePacketColors(const PinholeCamera& camera, const Scene& scene,
+                            int startX, int startY, int endX, int endY, unsigned samples,
+                            const RenderConfig& config, const TileView& pixels, ShadeFunc shade) {
+        const int side = std::clamp(int(config.packetSize), 1, 8);
+        const int width = camera.getWidth(), height = camera.getHeight();
+
+        std::vector<Ray> rays;
+        std::vector<Sampler> generators;
+        rays.reserve(side * side);
+        generators.reserve(side * side);
+        RGB accumulated[RayPacket::MAX_RAYS];
+
+        for (int blockY = startY; blockY < endY; blockY += side) {
+            for (int blockX = startX; blockX < endX; blockX += side) {
+                int blockEndX = std::min(blockX + side, endX), blockEndY = std::min(blockY + side, endY);
+                std::fill(accumulated, accumulated + RayPacket::MAX_RAYS, RGB(0, 0, 0));
+
+                for (unsigned i = 0; i < samples; i++) {
+                    rays.clear();
+                    generators.clear();
+                    for (int y = blockY; y < blockEndY; y++) {
+                        float ny = float(y) - (height / 2.0f);
+                        for (int x = blockX; x < blockEndX; x++) {
+                            float nx = float(x) - (width / 2.0f);
+                            Sampler rng = Sampler::forSample(config.sampler, config.seed, nx, ny, i);
+                            double u, v;
+                            rng.next2D(u, v);
+                            float x_offset = nx + u;
+                            float y_offset = ny + v;
+                            rays.push_back(camera.generateRay(x_offset, y_offset));
+                            generators.push_back(rng);
+                        }
+                    }
+
+                    RayPacket packet(rays.data(), int(rays.size()));
+                    PacketHits hits(CAMERA_RAY_DISTANCE);
+                    scene.closestHitPacket(packet, hits);
+
+                    for (size_t r = 0; r < rays.size(); r++) {
+                        auto hit = hits.hit(int(r));
+                        std::optional<Intersection> intersection = std::nullopt;
+                        if (hit) intersection = scene.surfaceAt(rays[r], *hit);
+                        accumulated[r] += shade(rays[r], intersection, scene, config, generators[r]);
+                    }
+                }
+
+                int r = 0;
+                for (int y = blockY; y < blockEndY; y++) {
+                    for (int x = blockX; x < blockEndX; x++) {
+                        pixels.at(x, y) = accumulated[r++] / samples;
+                    }
+                }
+            }
+        }
+    }
+
+    RGB photonMappingColor(const Ray& ray, const std::optional<Intersection>& intersection,
+                           const Scene& scene, const RenderConfig& config, Sampler& rng) {
+        if (intersection) {
+            if (config.photonMap && config.kernel) {
+                return scene.ecuacionRenderFotones(
+                    intersection->point, ray.direction, *intersection->material,
+                    intersection->normal, *config.photonMap, config.kPhotons,
+                    config.radius, false, config.kernel, rng, 0.0,
+                    config.causticMap, config.kCaustic, config.causticRadius);
+            } else {
+                return intersection->material->diffuse;
+            }
+        }
+
+        return RGB(0, 0, 0);
+    }
+
+    // Color of a camera ray for each algorithm, as taken by sampleOnce
+    auto rayTracingColor(const PinholeCamera& camera) {
+        return [&camera](const Ray& ray, const Scene& scene, const RenderConfig&, Sampler&) {
+            return camera.traceRay(ray, scene);
+        };
+    }
+
+    auto pathTracingColor(const PinholeCamera& camera) {
+        return [&camera](const Ray& ray, const Scene& scene, const RenderConfig& config, Sampler& rng) {
+            return camera.tracePathIterative(ray, scene, rng, config);
+        };
+    }
+
+    RGB photonMappingRayColor(const Ray& ray, const Scene& scene, const RenderConfig& config, Sampler& rng) {
+        return photonMappingColor(ray, scene.intersect(ray), scene, config, rng);
+    }
+}
+
+void RenderingStrategy::calculateTileColors(const PinholeCamera& camera, const Scene& scene,
+                                            int startX, int startY, int endX, int endY, unsigned samples,
+                                            const RenderConfig& config, const TileView& pixels) const {
+    const int width = camera.getWidth(), height = camera.getHeight();
+    for (int y = startY; y < endY; ++y) {
+        float ny = float(y) - (height / 2.0f);
+        for (int x = startX; x < endX; ++x) {
+            float nx = float(x) - (width / 2.0f);
+            pixels.at(x, y) = calculatePixelColor(camera, scene, nx, ny, samples, config);
+        }
+    }
 }
 
 RGB RayTracingStrategy::calculatePixelColor(const PinholeCamera& camera, const Scene& scene,
                                            float x, float y, unsigned samples,
                                            const RenderConfig& config) const {
-    return samplePixelColor(camera, scene, x, y, samples, config,
-        [&camera](const Ray& ray, const Scene& scene, const RenderConfig&) {
-            return camera.traceRay(ray, scene);
+    return samplePixelColor(camera, scene, x, y, samples, config, rayTracingColor(camera));
+}
+
+RGB RayTracingStrategy::sampleColor(const PinholeCamera& camera, const Scene& scene,
+                                    float x, float y, unsigned sample,
+                                    const RenderConfig& config) const {
+    return sampleOnce(camera, scene, x, y, sample, config, rayTracingColor(camera));
+}
+
+void RayTracingStrategy::calculateTileColors(const PinholeCamera& camera, const Scene& scene,
+                                             int startX, int startY, int endX, int endY, unsigned samples,
+                                             const RenderConfig& config, const TileView& pixels) const {
+    if (config.packetSize == 0) {
+        RenderingStrategy::calculateTileColors(camera, scene, startX, startY, endX, endY, samples, config, pixels);
+        return;
+    }
+    samplePacketColors(camera, scene, startX, startY, endX, endY, samples, config, pixels,
+        [&camera](const Ray& ray, const std::optional<Intersection>& intersection,
+                  const Scene& scene, const RenderConfig&, Sampler&) {
+            return camera.shadeHit(ray, intersection, scene);
         }
     );
 }
@@ -33,33 +173,35 @@ RGB RayTracingStrategy::calculatePixelColor(const PinholeCamera& camera, const S
 RGB PathTracingStrategy::calculatePixelColor(const PinholeCamera& camera, const Scene& scene,
                                             float x, float y, unsigned samples,
                                             const RenderConfig& config) const {
-    return samplePixelColor(camera, scene, x, y, samples, config,
-        [&camera](const Ray& ray, const Scene& scene, const RenderConfig&) {
-            return camera.tracePath(ray, scene);
-        }
-    );
+    return samplePixelColor(camera, scene, x, y, samples, config, pathTracingColor(camera));
+}
+
+RGB PathTracingStrategy::sampleColor(const PinholeCamera& camera, const Scene& scene,
+                                     float x, float y, unsigned sample,
+                                     const RenderConfig& config) const {
+    return sampleOnce(camera, scene, x, y, sample, config, pathTracingColor(camera));
 }
 
 RGB PhotonMappingStrategy::calculatePixelColor(const PinholeCamera& camera, const Scene& scene,
                                               float x, float y, unsigned samples,
                                               const RenderConfig& config) const {
-    return samplePixelColor(camera, scene, x, y, samples, config,
-        [](const Ray& ray, const Scene& scene, const RenderConfig& config) {
-            auto intersection = scene.intersect(ray);
-            if (intersection) {
-                if (config.photonMap && config.kernel) {
-                    return scene.ecuacionRenderFotones(
-                        intersection->point, ray.direction, intersection->material,
-                        intersection->normal, *config.photonMap, config.kPhotons,
-                        config.radius, false, config.kernel);
-                } else {
-                    return intersection->material.diffuse;
-                }
-            }
+    return samplePixelColor(camera, scene, x, y, samples, config, photonMappingRayColor);
+}
 
-            return RGB(0, 0, 0);
-        }
-    );
+RGB PhotonMappingStrategy::sampleColor(const PinholeCamera& camera, const Scene& scene,
+                                       float x, float y, unsigned sample,
+                                       const RenderConfig& config) const {
+    return sampleOnce(camera, scene, x, y, sample, config, photonMappingRayColor);
+}
+
+void PhotonMappingStrategy::calculateTileColors(const PinholeCamera& camera, const Scene& scene,
+                                                int startX, int startY, int endX, int endY, unsigned samples,
+                                                const RenderConfig& config, const TileView& pixels) const {
+    if (config.packetSize == 0) {
+        RenderingStrategy::calculateTileColors(camera, scene, startX, startY, endX, endY, samples, config, pixels);
+        return;
+    }
+    samplePacketColors(camera, scene, startX, startY, endX, endY, samples, config, pixels, photonMappingColor);
 }
 
 std::unique_ptr<RenderingStrategy> StrategyFactory::createStrategy(RenderingAlgorithm algorithm) {
@@ -0,0 +1,67 @@
+#include "../include/sampler.hpp"
+
+#include <array>
+
+namespace {
+    // Generator matrices of the first two Sobol dimensions, one column per index bit
+    constexpr std::array<std::array<uint32_t, 32>, 2> SOBOL_DIRECTIONS = [] {
+        std::array<std::array<uint32_t, 32>, 2> directions{};
+        uint32_t v = 1u << 31;
+        for (int bit = 0; bit < 32; bit++) {
+            directions[0][bit] = 1u << (31 - bit);     // Van der Corput
+            directions[1][bit] = v;                    // Polynomial x + 1
+            v ^= v >> 1;
+        }
+        return directions;
+    }();
+
+    uint32_t sobol2D(uint32_t index, int dimension) {
+        uint32_t x = 0;
+        for (int bit = 0; index != 0; bit++, index >>= 1) {
+            if (index & 1) x ^= SOBOL_DIRECTIONS[dimension][bit];
+        }
+        return x;
+    }
+
+    uint32_t reverseBits(uint32_t x) {
+        x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+        x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+        x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+        x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    // Laine-Karras hash: each bit only depends on itself and the bits below it
+    uint32_t laineKarras(uint32_t x, uint32_t seed) {
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return x;
+    }
+
+    // Owen scrambling in base 2: each bit is flipped depending on the bits above it
+    uint32_t nestedUniformScramble(uint32_t x, uint32_t seed) {
+        return reverseBits(laineKarras(reverseBits(x), seed));
+    }
+
+    uint32_t hashSeed(uint64_t scramble, uint32_t key) {
+        return uint32_t(PCG32::mix(scramble ^ (uint64_t(key) + 1) * 0x9e3779b97f4a7c15ULL));
+    }
+}
+
+/***********
+ * Sampler *
+ ***********/
+
+double Sampler::sobol(uint32_t dimension) const {
+    // Both dimensions of a pair share the shuffled index, so their points stay a 2D net
+    uint32_t pair = dimension / 2;
+    uint32_t shuffled = nestedUniformScramble(index, hashSeed(scramble, 2 * pair + 0x10000));
+    uint32_t x = sobol2D(shuffled, dimension & 1);
+
+    uint32_t seed = hashSeed(scramble, dimension);
+    x = type == SamplerType::OWEN_SOBOL ? nestedUniformScramble(x, seed) : x ^ seed;
+    return x * 0x1p-32;
+}
@@ -0,0 +1,117 @@
+#include "../include/thread_pool.hpp"
+
+#include <algorithm>
+#include <exception>
+
+struct ThreadPool::Job {
+    std::function<void(int)> work;
+    int parallelism = 0;
+    int next = 0;                    // Next index to hand out, guarded by the pool mutex
+    std::atomic<int> remaining{0};   // Indices not finished yet
+    std::exception_ptr error;        // First exception thrown by work, guarded by mutex
+    std::mutex mutex;
+    std::condition_variable done;
+};
+
+ThreadPool::ThreadPool(int numThreads) {
+    grow(numThreads);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wakeUp_.notify_all();
+    for (auto& t : threads_) t.join();
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool(int(std::thread::hardware_concurrency()));
+    return pool;
+}
+
+int ThreadPool::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return int(threads_.size());
+}
+
+void ThreadPool::grow(int numThreads) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    while (int(threads_.size()) < numThreads) {
+        threads_.emplace_back([this] { workerLoop(); });
+    }
+}
+
+ThreadPool::JobHandle ThreadPool::submit(int parallelism, std::function<void(int)> work) {
+    auto job = std::make_shared<Job>();
+    job->work = std::move(work);
+    job->parallelism = std::max(parallelism, 1);
+    job->remaining = job->parallelism;
+
+    grow(job->parallelism - 1);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.push_back(job);
+    }
+    if (job->parallelism > 1) wakeUp_.notify_all();
+    else wakeUp_.notify_one();
+    return job;
+}
+
+void ThreadPool::wait(const JobHandle& job) {
+    JobHandle claimed;
+    int index;
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!claim(job, claimed, index)) break;
+        }
+        execute(claimed, index);
+    }
+
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->done.wait(lock, [&] { return job->remaining.load() == 0; });
+    if (job->error) std::rethrow_exception(job->error);
+}
+
+bool ThreadPool::claim(const JobHandle& only, JobHandle& job, int& index) {
+    auto it = only ? std::find(pending_.begin(), pending_.end(), only) : pending_.begin();
+    if (it == pending_.end()) return false;
+
+    job = *it;
+    index = job->next++;
+    if (job->next == job->parallelism) pending_.erase(it);
+    return true;
+}
+
+void ThreadPool::execute(const JobHandle& job, int index) {
+    // An exception must not kill the worker or leave the index unfinished,
+    // wait() rethrows the first one once every index is done
+    try {
+        job->work(index);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        if (!job->error) job->error = std::current_exception();
+    }
+    if (--job->remaining == 0) {
+        // Taking the lock orders this notify after the waiter checks remaining
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->done.notify_all();
+    }
+}
+
+void ThreadPool::workerLoop() {
+    JobHandle job;
+    int index;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wakeUp_.wait(lock, [&] { return stopping_ || !pending_.empty(); });
+            if (stopping_ && pending_.empty()) return;
+            claim(nullptr, job, index);
+        }
+        execute(job, index);
+        job.reset();
+    }
+}
@@ -0,0 +1,224 @@
+#include "../include/object3D.hpp"
+#include "../include/simd.hpp"
+
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+    constexpr float EPS = 1e-8f;
+    constexpr int W = TriangleMesh::BLOCK_WIDTH;
+
+    struct RayLanes {
+        float ox, oy, oz;
+        float dx, dy, dz;
+    };
+
+    // Möller-Trumbore over every lane of a block, with the same operations and
+    // tests as Triangle::hitDistance. Writes the distance of every lane to t and
+    // returns the mask of the lanes that are hit in front of the origin.
+    template <class Block>
+    unsigned laneHits(const Block& b, const RayLanes& r, float* t) {
+        using namespace simd;
+        const V zero = set1(0.0f), one = set1(1.0f), eps = set1(EPS);
+        const V dx = set1(r.dx), dy = set1(r.dy), dz = set1(r.dz);
+
+        unsigned hits = 0;
+        for (int i = 0; i < W; i += WIDTH) {
+            V e1x = load(b.e1x + i), e1y = load(b.e1y + i), e1z = load(b.e1z + i);
+            V e2x = load(b.e2x + i), e2y = load(b.e2y + i), e2z = load(b.e2z + i);
+
+            // h = d x e2, det = e1 . h
+            V hx = sub(mul(dy, e2z), mul(dz, e2y));
+            V hy = sub(mul(dz, e2x), mul(dx, e2z));
+            V hz = sub(mul(dx, e2y), mul(dy, e2x));
+            V det = dot(e1x, e1y, e1z, hx, hy, hz);
+            V f = div(one, det);
+
+            // s = o - v0, u = f (s . h)
+            V sx = sub(set1(r.ox), load(b.v0x + i));
+            V sy = sub(set1(r.oy), load(b.v0y + i));
+            V sz = sub(set1(r.oz), load(b.v0z + i));
+            V u = mul(f, dot(sx, sy, sz, hx, hy, hz));
+
+            // q = s x e1, v = f (d . q), t = f (e2 . q)
+            V qx = sub(mul(sy, e1z), mul(sz, e1y));
+            V qy = sub(mul(sz, e1x), mul(sx, e1z));
+            V qz = sub(mul(sx, e1y), mul(sy, e1x));
+            V v = mul(f, dot(dx, dy, dz, qx, qy, qz));
+            V dist = mul(f, dot(e2x, e2y, e2z, qx, qy, qz));
+
+            M mask = ge(simd::abs(det), eps);
+            mask = both(mask, both(ge(u, zero), le(u, one)));
+            mask = both(mask, both(ge(v, zero), le(add(u, v), one)));
+            mask = both(mask, gt(dist, eps));
+
+            store(t + i, dist);
+            hits |= bits(mask) << i;
+        }
+        return hits;
+    }
+}
+
+/****************
+ * TriangleMesh *
+ ****************/
+
+TriangleMesh::TriangleMesh(const vector<float>& positions, vector<uint32_t> indices, const Material& material) :
+    Object3D(material), indices(std::move(indices)) {
+    if (positions.size() % 3 != 0 || this->indices.size() % 3 != 0) {
+        throw invalid_argument("TriangleMesh needs three coordinates per vertex and three indices per triangle");
+    }
+
+    size_t nVertices = positions.size() / 3;
+    vx.resize(nVertices);
+    vy.resize(nVertices);
+    vz.resize(nVertices);
+    for (size_t i = 0; i < nVertices; i++) {
+        vx[i] = positions[3 * i];
+        vy[i] = positions[3 * i + 1];
+        vz[i] = positions[3 * i + 2];
+        bounds.expand(Point(vx[i], vy[i], vz[i]));
+    }
+
+    size_t nTriangles = triangleCount();
+    vector<AABB> boxes(nTriangles);
+    for (size_t i = 0; i < nTriangles; i++) {
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = this->indices[3 * i + k];
+            if (v >= nVertices) throw out_of_range("TriangleMesh index out of range");
+            boxes[i].expand(Point(vx[v], vy[v], vz[v]));
+        }
+    }
+
+    vector<uint32_t> order;
+    buildSAH(boxes, BLOCK_WIDTH, BLOCK_WIDTH, nodes, order);
+
+    // Pack the triangles of every leaf into its block
+    for (BVHNode& node : nodes) {
+        if (node.count == 0) continue;
+        TriangleBlock block = {};
+        for (int lane = 0; lane < BLOCK_WIDTH; lane++) {
+            if (lane >= node.count) {
+                block.triangle[lane] = UINT32_MAX;
+                continue;
+            }
+            uint32_t tri = order[node.offset + lane];
+            uint32_t a = this->indices[3 * tri], b = this->indices[3 * tri + 1], c = this->indices[3 * tri + 2];
+            block.v0x[lane] = vx[a];
+            block.v0y[lane] = vy[a];
+            block.v0z[lane] = vz[a];
+            block.e1x[lane] = vx[b] - vx[a];
+            block.e1y[lane] = vy[b] - vy[a];
+            block.e1z[lane] = vz[b] - vz[a];
+            block.e2x[lane] = vx[c] - vx[a];
+            block.e2y[lane] = vy[c] - vy[a];
+            block.e2z[lane] = vz[c] - vz[a];
+            block.triangle[lane] = tri;
+        }
+        node.offset = uint32_t(blocks.size());
+        blocks.push_back(block);
+    }
+}
+
+optional<float> TriangleMesh::traverse(const Ray& ray, float maxT, bool anyHit, uint32_t& triangle) const {
+    if (nodes.empty()) return nullopt;
+
+    const BoxRay boxRay(ray.origin, ray.direction);
+    const RayLanes lanes{ray.origin.x, ray.origin.y, ray.origin.z,
+                         ray.direction.x, ray.direction.y, ray.direction.z};
+
+    float closest = maxT;
+    uint32_t closestTriangle = UINT32_MAX;
+    alignas(32) float t[BLOCK_WIDTH];
+
+    uint32_t stack[BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+        const BVHNode& node = nodes[stack[--stackSize]];
+        if (!boxRay.hits(node, closest)) continue;
+
+        if (node.count > 0) {
+            const TriangleBlock& block = blocks[node.offset];
+            for (unsigned hits = laneHits(block, lanes, t); hits != 0; hits &= hits - 1) {
+                int lane = countr_zero(hits);
+                uint32_t tri = block.triangle[lane];
+                // Ties go to the lowest triangle index, like a scan over separate triangles
+                bool tie = closestTriangle != UINT32_MAX && t[lane] == closest && tri < closestTriangle;
+                if (t[lane] < closest || tie) {
+                    closest = t[lane];
+                    closestTriangle = tri;
+                    if (anyHit) {
+                        triangle = tri;
+                        return closest;
+                    }
+                }
+            }
+        } else {
+            uint32_t left = uint32_t(&node - nodes.data()) + 1;
+            uint32_t right = node.offset;
+            // Push the far child first so the near one is visited next
+            if (boxRay.negative[node.axis]) {
+                stack[stackSize++] = left;
+                stack[stackSize++] = right;
+            } else {
+                stack[stackSize++] = right;
+                stack[stackSize++] = left;
+            }
+        }
+    }
+
+    if (closestTriangle == UINT32_MAX) return nullopt;
+    triangle = closestTriangle;
+    return closest;
+}
+
+optional<float> TriangleMesh::hitDistance(const Ray& ray) const {
+    uint32_t triangle;
+    return traverse(ray, numeric_limits<float>::infinity(), false, triangle);
+}
+
+optional<float> TriangleMesh::hitElement(const Ray& ray, uint32_t& triangle) const {
+    triangle = 0;
+    return traverse(ray, numeric_limits<float>::infinity(), false, triangle);
+}
+
+bool TriangleMesh::intersectsP(const Ray& ray, float maxT) const {
+    uint32_t triangle;
+    return traverse(ray, maxT, true, triangle).has_value();
+}
+
+Direction TriangleMesh::normalAtElement(const Point&, uint32_t triangle) const {
+    uint32_t a = indices[3 * triangle], b = indices[3 * triangle + 1], c = indices[3 * triangle + 2];
+    Point pa(vx[a], vy[a], vz[a]), pb(vx[b], vy[b], vz[b]), pc(vx[c], vy[c], vz[c]);
+    return (pb - pa).cross(pc - pa).normalize();
+}
+
+// A point alone does not tell which triangle was hit and searching every triangle
+// is O(N) per shading point, so callers must go through normalAtElement
+Direction TriangleMesh::normalAt(const Point&) const {
+    throw logic_error("TriangleMesh::normalAt needs the triangle, use normalAtElement");
+}
+
+AABB TriangleMesh::boundingBox() const {
+    return bounds;
+}
+
+size_t TriangleMesh::memoryUsage() const {
+    return (vx.capacity() + vy.capacity() + vz.capacity()) * sizeof(float)
+        + indices.capacity() * sizeof(uint32_t)
+        + blocks.capacity() * sizeof(TriangleBlock)
+        + nodes.capacity() * sizeof(BVHNode);
+}
+
+string TriangleMesh::toString() const {
+    ostringstream oss;
+    oss << "TriangleMesh: " << triangleCount() << " triangles, " << vertexCount() << " vertices";
+    return oss.str();
+}
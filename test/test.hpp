@@ -2,6 +2,8 @@
 
 #include <string>
 
+enum class QueueType;
+
 // Functions from test_geometry.cpp
 void test_translate();
 void test_rotate_x();
@@ -15,8 +17,27 @@ void testSphereIntersection();
 void testPlaneIntersection();
 void testTriangleIntersection();
 void testConeIntersection();
+void test_bvh_intersection();
+void test_bvh_depth_limit();
+void test_material_table();
+void test_triangle_mesh();
+void test_mesh_depth_limit();
+void test_packet_intersection();
+void test_packet_depth_limit();
+void test_mesh_loader();
 void test_all_intersections();
 
+// Functions from test_photon.cpp
+void test_foton_compacto();
+void test_kernels();
+void test_kdtree_parallel_build();
+void test_busqueda_fotones();
+void test_emision_paralela();
+void test_mapa_causticas();
+void test_progressive_photon_mapping();
+void test_progressive_photon_mapping_convergence();
+void run_photon_benchmark();
+
 // Functions from test_p2.cpp (Image & ToneMapping)
 void test_readWritePPM(const std::string& file);
 void testClamp(const std::string& path);
@@ -33,6 +54,22 @@ void test_bmp_format();
 
 // Functions from test_cornell_box.cpp
 void test_cornell_box_rendering();
+class Scene;
+Scene buildCornellBox();
+Scene buildSphereScene(bool floor = false);
+void run_path_tracer_benchmark(const Scene& scene);
+void test_sampler_stratification();
+void run_sampler_convergence(const Scene& scene);
 
 // Functions from test_parallel.cpp
 void test_parallel_rendering();
+void test_task_queue(QueueType type, const std::string& name);
+void test_thread_pool();
+void test_tile_orders();
+void test_tile_hook();
+void test_cpu_affinity();
+void test_guided_scheduling();
+void test_parallel_determinism();
+void test_adaptive_sampling();
+void test_progressive_resume();
+void run_parallel_benchmark();
@@ -1,6 +1,9 @@
 #include <iostream>
 #include <vector>
 #include <memory>
+#include <chrono>
+#include <cassert>
+#include <cmath>
 
 #include "../include/object3D.hpp"
 #include "../include/pinholeCamera.hpp"
@@ -8,7 +11,7 @@
 
 using namespace std;
 
-void run_cornell_box_test() {
+Scene buildCornellBox() {
 
     Scene scene;
 
@@ -53,6 +56,146 @@ void run_cornell_box_test() {
     shared_ptr<PointLight> shared_pointLight = make_shared<PointLight>(Point(0, 0.5, 0), RGB(8, 8, 8)); 
     scene.addLight(shared_pointLight); 
 
+    return scene;
+}
+
+// Red sphere under a point light, optionally on a grey floor: the small scene of the parallel tests
+Scene buildSphereScene(bool floor) {
+    Scene scene;
+    scene.addObject(make_shared<Sphere>(Point(0, 0, 0.5), 0.4, Material(RGB(0.8, 0.2, 0.2))));
+    if (floor) scene.addObject(make_shared<Plane>(Direction(0, 1, 0), Material(RGB(0.5, 0.5, 0.5)), 1));
+    scene.addLight(make_shared<PointLight>(Point(0, 0.8, 0), RGB(2, 2, 2)));
+    return scene;
+}
+
+// Recursive vs iterative path tracer on the same Cornell box and the same random numbers
+void run_path_tracer_benchmark(const Scene& scene) {
+    const int width = 128, height = 128;
+    const unsigned samples = 8;
+    PinholeCamera camera(Point(0, 0, -0.5), 45, width, height);
+    RenderConfig config;
+
+    auto renderWith = [&](bool iterative, double& seconds) {
+        std::vector<RGB> pixels(width * height);
+        auto start = chrono::high_resolution_clock::now();
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                float nx = x - width / 2.0f, ny = y - height / 2.0f;
+                for (unsigned i = 0; i < samples; i++) {
+                    Sampler rng = Sampler::forSample(config.sampler, config.seed, nx, ny, i);
+                    Ray ray = camera.generateRay(nx + rand0_1(rng), ny + rand0_1(rng));
+                    pixels[y * width + x] += iterative ? camera.tracePathIterative(ray, scene, rng, config)
+                                                       : camera.tracePath(ray, scene, rng);
+                }
+            }
+        }
+        seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+        return pixels;
+    };
+
+    double recursiveTime, iterativeTime;
+    auto recursive = renderWith(false, recursiveTime);
+    auto iterative = renderWith(true, iterativeTime);
+
+    double maxDifference = 0.0;
+    for (size_t i = 0; i < recursive.size(); i++) {
+        RGB d = recursive[i] - iterative[i];
+        maxDifference = max(maxDifference, double(max({fabs(d.r), fabs(d.g), fabs(d.b)})));
+    }
+
+    cout << "Path tracer benchmark (" << width << "x" << height << ", " << samples << " spp)" << endl;
+    cout << "  Recursive: " << recursiveTime << " s" << endl;
+    cout << "  Iterative: " << iterativeTime << " s" << endl;
+    cout << "  Max pixel difference: " << maxDifference << endl;
+    assert(maxDifference < 1e-3);
+}
+
+// Camera rays one by one vs in 8x8 packets: same image, packets should be faster
+void run_packet_benchmark(const Scene& scene) {
+    const int width = 256, height = 256;
+    const unsigned samples = 4;
+    PinholeCamera camera(Point(0, 0, -0.5), 45, width, height);
+    RenderConfig config(RenderingAlgorithm::RAY_TRACING, RenderingMode::SEQUENTIAL);
+
+    auto renderWith = [&](unsigned packetSize, double& seconds) {
+        config.packetSize = packetSize;
+        auto start = chrono::high_resolution_clock::now();
+        Image image = camera.render(scene, samples, config);
+        seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+        return image;
+    };
+
+    double scalarTime, packetTime;
+    Image scalar = renderWith(0, scalarTime);
+    Image packet = renderWith(8, packetTime);
+
+    for (size_t i = 0; i < scalar.pixels.size(); i++) {
+        const RGB& a = scalar.pixels[i];
+        const RGB& b = packet.pixels[i];
+        assert(a.r == b.r && a.g == b.g && a.b == b.b);
+    }
+
+    cout << "Packet tracing benchmark (" << width << "x" << height << ", " << samples << " spp, ray tracing)" << endl;
+    cout << "  Ray by ray:   " << scalarTime << " s" << endl;
+    cout << "  8x8 packets:  " << packetTime << " s" << endl;
+}
+
+// The first 16 samples of a pixel fall one in each 4x4 cell of every pair of dimensions
+void test_sampler_stratification() {
+    for (SamplerType type : {SamplerType::SOBOL, SamplerType::OWEN_SOBOL}) {
+        for (int pixel = 0; pixel < 8; pixel++) {
+            bool cells[3][16] = {};
+            for (unsigned i = 0; i < 16; i++) {
+                Sampler sampler = Sampler::forSample(type, 5, float(pixel), 0.0f, i);
+                for (int pair = 0; pair < 3; pair++) {
+                    double u, v;
+                    sampler.next2D(u, v);
+                    assert(u >= 0.0 && u < 1.0 && v >= 0.0 && v < 1.0);
+                    int cell = int(u * 4) * 4 + int(v * 4);
+                    assert(!cells[pair][cell]);
+                    cells[pair][cell] = true;
+                }
+            }
+        }
+    }
+    cout << "Sampler stratification test passed!" << endl;
+}
+
+// Error against a converged Cornell box at the same samples per pixel
+void run_sampler_convergence(const Scene& scene) {
+    const int width = 32, height = 32;
+    const unsigned samples = 16;
+    PinholeCamera camera(Point(0, 0, -0.5), 45, width, height);
+    RenderConfig config(RenderingAlgorithm::PATH_TRACING, RenderingMode::SEQUENTIAL);
+    config.seed = 11;
+
+    Image reference = camera.render(scene, 1024, config);
+    auto rmse = [&](SamplerType type) {
+        config.sampler = type;
+        Image image = camera.render(scene, samples, config);
+        double sum = 0.0;
+        for (size_t i = 0; i < image.pixels.size(); i++) {
+            RGB d = image.pixels[i] - reference.pixels[i];
+            sum += d.r * d.r + d.g * d.g + d.b * d.b;
+        }
+        return std::sqrt(sum / (3.0 * image.pixels.size()));
+    };
+
+    double independent = rmse(SamplerType::INDEPENDENT);
+    double sobol = rmse(SamplerType::SOBOL);
+    double owen = rmse(SamplerType::OWEN_SOBOL);
+
+    cout << "Sampler convergence (" << width << "x" << height << ", " << samples << " spp, RMSE)" << endl;
+    cout << "  Independent: " << independent << endl;
+    cout << "  Sobol:       " << sobol << endl;
+    cout << "  Owen Sobol:  " << owen << endl;
+    assert(owen < independent);
+}
+
+void run_cornell_box_test() {
+
+    Scene scene = buildCornellBox();
+
     // Camera positioned closer to see all objects
     PinholeCamera camera(Point(0, 0, -0.5), 45, 512, 512);
 
@@ -60,5 +203,10 @@ void run_cornell_box_test() {
     Image image = camera.renderPathTracing(scene, 16);  // Reduced samples for faster testing
     image.writePPM("test_all_primitives.ppm");
     cout << "Rendered to test_all_primitives.ppm" << endl;
+
+    test_sampler_stratification();
+    run_sampler_convergence(scene);
+    run_path_tracer_benchmark(scene);
+    run_packet_benchmark(scene);
 }
 
@@ -1,6 +1,13 @@
 #include <iostream>
 #include <cassert>
+#include <random>
+#include <limits>
+#include <fstream>
+#include <filesystem>
+#include <stdexcept>
 #include "../include/object3D.hpp"
+#include "../include/ray_packet.hpp"
+#include "../include/mesh_loader.hpp"
 #include "../include/constants.hpp"
 
 void test_sphere_intersection() {
@@ -48,6 +55,377 @@ void test_cylinder_intersection() {
     std::cout << "Cylinder intersection test passed!" << std::endl;
 }
 
+// The BVH behind Scene::intersect must return the same hit as a linear scan
+void test_bvh_intersection() {
+    std::mt19937 gen(1234);
+    std::uniform_real_distribution<float> pos(-2.0f, 2.0f);
+    std::uniform_real_distribution<float> size(0.01f, 0.2f);
+
+    Scene scene;
+    scene.addObject(std::make_shared<Plane>(Direction(0, 1, 0), Material(), 3));
+    for (int i = 0; i < 300; i++) {
+        Point p(pos(gen), pos(gen), pos(gen));
+        float s = size(gen);
+        if (i % 3 == 0) {
+            scene.addObject(std::make_shared<Sphere>(p, s, Material()));
+        } else if (i % 3 == 1) {
+            scene.addObject(std::make_shared<Triangle>(p, p + Direction(s, 0, 0), p + Direction(0, s, s), Material()));
+        } else {
+            scene.addObject(std::make_shared<Cylinder>(p, Direction(0, 1, 0), s, 2 * s, Material()));
+        }
+    }
+
+    for (int i = 0; i < 2000; i++) {
+        Ray ray(Point(pos(gen), pos(gen), pos(gen)), Direction(pos(gen), pos(gen), pos(gen)));
+
+        std::optional<Intersection> expected = std::nullopt;
+        for (const auto& object : scene.objects) {
+            auto hit = object->intersect(ray);
+            if (hit && (!expected || hit->distance < expected->distance)) expected = hit;
+        }
+
+        auto actual = scene.intersect(ray, std::numeric_limits<float>::infinity());
+        assert(expected.has_value() == actual.has_value());
+        if (expected) assert(expected->distance == actual->distance);
+
+        // The any-hit query must agree with the closest hit
+        float maxT = std::uniform_real_distribution<float>(0.1f, 8.0f)(gen);
+        assert(scene.occluded(ray, maxT) == (expected && expected->distance < maxT));
+    }
+    std::cout << "BVH intersection test passed!" << std::endl;
+}
+
+// Spheres with centres spaced geometrically towards the origin along each axis: every SAH
+// split only peels off the largest few, which without a depth limit gives about 70 levels
+static Scene sphereChains() {
+    Scene scene;
+    for (int axis = 0; axis < 3; axis++) {
+        float x = 1.0f;
+        for (int i = 0; i < 31; i++, x /= 16.0f) {
+            float c[3] = {0, 0, 0};
+            c[axis] = x;
+            scene.addObject(std::make_shared<Sphere>(Point(c[0], c[1], c[2]), x * 0.005f, Material()));
+        }
+    }
+    return scene;
+}
+
+// The hierarchy over sphereChains must still fit the traversal stacks
+void test_bvh_depth_limit() {
+    Scene scene = sphereChains();
+    std::vector<AABB> boxes;
+    for (const auto& object : scene.objects) boxes.push_back(object->boundingBox());
+
+    std::vector<BVHNode> nodes;
+    std::vector<uint32_t> order;
+    buildSAH(boxes, 4, 1, nodes, order);
+    // Depth of every node, children come after their parent
+    std::vector<int> depth(nodes.size(), 0);
+    int deepest = 0;
+    for (std::size_t i = 0; i < nodes.size(); i++) {
+        deepest = std::max(deepest, depth[i]);
+        if (nodes[i].count == 0) depth[i + 1] = depth[nodes[i].offset] = depth[i] + 1;
+    }
+    assert(deepest < BVH_STACK_SIZE);
+
+    // A ray shot at each sphere from three radii away is closest to that sphere. The boxes
+    // are padded, so near the origin it also enters every deeper box. The smallest spheres
+    // are skipped, their squared radius is below what a float holds
+    for (std::size_t i = 0; i < scene.objects.size(); i++) {
+        const Sphere& sphere = static_cast<const Sphere&>(*scene.objects[i]);
+        if (sphere.radius < 1e-15f) continue;
+        int axis = int(i / 31);
+        float offset[3] = {0, 0, 0}, d[3] = {0, 0, 0};
+        offset[(axis + 2) % 3] = 3 * sphere.radius;
+        d[(axis + 2) % 3] = -1;
+        Ray ray(Point(sphere.center.x + offset[0], sphere.center.y + offset[1], sphere.center.z + offset[2]),
+                Direction(d[0], d[1], d[2]));
+
+        auto hit = scene.closestHit(ray, std::numeric_limits<float>::infinity());
+        assert(hit.has_value() && hit->primitiveId == uint32_t(i));
+        assert(scene.occluded(ray, 3 * sphere.radius));
+        assert(!scene.occluded(ray, sphere.radius));
+    }
+    std::cout << "BVH depth limit test passed!" << std::endl;
+}
+
+// The same geometric chains as test_bvh_depth_limit, as the triangles of one mesh, plus a
+// large triangle behind the origin
+void test_mesh_depth_limit() {
+    std::vector<float> positions;
+    std::vector<uint32_t> indices;
+    for (int axis = 0; axis < 3; axis++) {
+        float x = 1.0f;
+        for (int i = 0; i < 31; i++, x /= 16.0f) {
+            // Triangle in the plane normal to axis + 2, with a corner on the axis
+            float s = x * 0.005f;
+            for (int corner = 0; corner < 3; corner++) {
+                float p[3] = {0, 0, 0};
+                p[axis] = x + (corner == 1 ? s : 0.0f);
+                p[(axis + 1) % 3] = corner == 2 ? s : 0.0f;
+                positions.insert(positions.end(), {p[0], p[1], p[2]});
+            }
+        }
+    }
+    positions.insert(positions.end(), {-1, -1, -1, 1, -1, -1, 0, 1, -1});
+    for (uint32_t i = 0; i < positions.size() / 3; i++) indices.push_back(i);
+    const uint32_t behind = uint32_t(indices.size() / 3 - 1);
+    TriangleMesh mesh(positions, indices, Material());
+
+    // Rays down the z axis go through the padded boxes of every chain near the origin, the
+    // deepest nodes of the mesh, and only hit the large triangle: the small ones are too
+    // small for the intersection test
+    std::mt19937 gen(5);
+    std::uniform_real_distribution<float> offset(1e-7f, 1e-5f);
+    for (int i = 0; i < 100; i++) {
+        Ray ray(Point(offset(gen), offset(gen), 1), Direction(0, 0, -1));
+        uint32_t triangle;
+        auto t = mesh.hitElement(ray, triangle);
+        assert(t.has_value() && triangle == behind && std::abs(*t - 2.0f) < 1e-5f);
+        assert(mesh.intersectsP(ray, 2.5f) && !mesh.intersectsP(ray, 1.5f));
+    }
+    std::cout << "Mesh depth limit test passed!" << std::endl;
+}
+
+// Packets through the deepest nodes of sphereChains agree with single rays
+void test_packet_depth_limit() {
+    Scene scene = sphereChains();
+    std::mt19937 gen(17);
+    std::uniform_real_distribution<float> offset(-1e-4f, 1e-4f);
+    for (int packetIndex = 0; packetIndex < 50; packetIndex++) {
+        // Camera-like packets aimed at the origin, where the boxes of every chain overlap
+        Point origin(0.3f, 0.2f, -2.0f);
+        std::vector<Ray> rays;
+        for (int i = 0; i < RayPacket::MAX_RAYS; i++) {
+            Point target(offset(gen), offset(gen), offset(gen));
+            rays.emplace_back(origin, target - origin);
+        }
+
+        RayPacket packet(rays.data(), RayPacket::MAX_RAYS);
+        PacketHits hits(std::numeric_limits<float>::infinity());
+        scene.closestHitPacket(packet, hits);
+        for (int i = 0; i < RayPacket::MAX_RAYS; i++) {
+            auto expected = scene.closestHit(rays[i], std::numeric_limits<float>::infinity());
+            auto actual = hits.hit(i);
+            assert(expected.has_value() == actual.has_value());
+            if (expected) assert(expected->distance == actual->distance && expected->primitiveId == actual->primitiveId);
+        }
+    }
+    std::cout << "Packet depth limit test passed!" << std::endl;
+}
+
+// Objects with equal materials share one entry of the scene material table
+void test_material_table() {
+    Material red(RGB(0.8, 0.2, 0.2));
+    Scene scene;
+    scene.addObject(std::make_shared<Sphere>(Point(0, 0, 2), 0.5, red));
+    scene.addObject(std::make_shared<Sphere>(Point(0, 0, 4), 0.5, Material(RGB(0.2, 0.8, 0.2))));
+    scene.addObject(std::make_shared<Sphere>(Point(0, 0, 6), 0.5, red));
+    assert(scene.materials.size() == 2);
+
+    auto hit = scene.closestHit(Ray(Point(0, 0, 0), Direction(0, 0, 1)));
+    assert(hit.has_value());
+    assert(hit->primitiveId == 0 && hit->materialId == 0);
+
+    auto intersection = scene.surfaceAt(Ray(Point(0, 0, 0), Direction(0, 0, 1)), *hit);
+    assert(intersection.material == &scene.materials[0]);
+    assert(abs(intersection.normal.z + 1.0f) < EPSILON);
+
+    // Many different materials, each added twice
+    Scene many;
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < 500; i++) {
+            Material m(RGB(i / 500.0f, 0.5f, 0.1f));
+            assert(many.addMaterial(m) == uint32_t(i));
+        }
+    }
+    assert(many.materials.size() == 500);
+    assert(many.addMaterial(Material(RGB(0, 0, 0), RGB(0, 0, 0), true)) == 500);
+    std::cout << "Material table test passed!" << std::endl;
+}
+
+// A mesh must report the same hits as its triangles added one by one
+void test_triangle_mesh() {
+    std::mt19937 gen(4321);
+    std::uniform_real_distribution<float> pos(-2.0f, 2.0f);
+    std::uniform_real_distribution<float> offset(-0.3f, 0.3f);
+
+    // Triangle soup sharing vertices: every triangle reuses the last vertex of the previous one
+    std::vector<float> positions;
+    std::vector<uint32_t> indices;
+    std::vector<Triangle> triangles;
+    Point last(pos(gen), pos(gen), pos(gen));
+    for (int i = 0; i < 1000; i++) {
+        Point a = i % 4 == 0 ? Point(pos(gen), pos(gen), pos(gen)) : last;
+        Point b = a + Direction(offset(gen), offset(gen), offset(gen));
+        Point c = a + Direction(offset(gen), offset(gen), offset(gen));
+        for (const Point& p : {a, b, c}) {
+            positions.insert(positions.end(), {p.x, p.y, p.z});
+        }
+        indices.insert(indices.end(), {uint32_t(3 * i), uint32_t(3 * i + 1), uint32_t(3 * i + 2)});
+        triangles.emplace_back(a, b, c, Material());
+        last = c;
+    }
+    TriangleMesh mesh(positions, indices, Material());
+    assert(mesh.triangleCount() == triangles.size());
+
+    for (int i = 0; i < 5000; i++) {
+        Ray ray(Point(pos(gen), pos(gen), pos(gen)), Direction(pos(gen), pos(gen), pos(gen)));
+
+        std::optional<float> expected = std::nullopt;
+        uint32_t expectedTriangle = 0;
+        for (size_t j = 0; j < triangles.size(); j++) {
+            auto t = triangles[j].hitDistance(ray);
+            if (t && (!expected || *t < *expected)) {
+                expected = t;
+                expectedTriangle = uint32_t(j);
+            }
+        }
+
+        uint32_t triangle;
+        auto actual = mesh.hitElement(ray, triangle);
+        assert(expected.has_value() == actual.has_value());
+        if (expected) {
+            assert(*expected == *actual && expectedTriangle == triangle);
+            Direction n = mesh.normalAtElement(ray.at(*actual), triangle);
+            assert((n - triangles[triangle].normal).mod() < EPSILON);
+        }
+
+        float maxT = std::uniform_real_distribution<float>(0.1f, 4.0f)(gen);
+        assert(mesh.intersectsP(ray, maxT) == (expected && *expected < maxT));
+    }
+
+    // Through the scene the triangle travels in the hit record
+    Scene scene;
+    scene.addObject(std::make_shared<TriangleMesh>(positions, indices, Material()));
+    const Triangle& target = triangles[7];
+    Point centroid = target.a + ((target.b - target.a) + (target.c - target.a)) / 3.0f;
+    Ray ray(Point(0, 0, -10), centroid - Point(0, 0, -10));
+    auto hit = scene.closestHit(ray, std::numeric_limits<float>::infinity());
+    assert(hit.has_value() && hit->primitiveId == 0);
+    auto t = triangles[hit->elementId].hitDistance(ray);
+    assert(t && *t == hit->distance);
+
+    // Without the triangle the normal is not searched for
+    bool threw = false;
+    try {
+        mesh.normalAt(centroid);
+    } catch (const std::logic_error&) {
+        threw = true;
+    }
+    assert(threw);
+    std::cout << "Triangle mesh test passed!" << std::endl;
+}
+
+// Packets must find the same closest hits as the rays traced one by one
+void test_packet_intersection() {
+    std::mt19937 gen(99);
+    std::uniform_real_distribution<float> pos(-2.0f, 2.0f);
+    std::uniform_real_distribution<float> size(0.05f, 0.4f);
+
+    Scene scene;
+    scene.addObject(std::make_shared<Plane>(Direction(0, 1, 0), Material(), 3));
+    scene.addObject(std::make_shared<TriangleMesh>(
+        std::vector<float>{-1, -1, 1, 1, -1, 1, 0, 1, 1}, std::vector<uint32_t>{0, 1, 2}, Material()));
+    for (int i = 0; i < 200; i++) {
+        Point p(pos(gen), pos(gen), pos(gen));
+        float s = size(gen);
+        if (i % 3 == 0) {
+            scene.addObject(std::make_shared<Sphere>(p, s, Material()));
+        } else if (i % 3 == 1) {
+            scene.addObject(std::make_shared<Triangle>(p, p + Direction(s, 0, 0), p + Direction(0, s, s), Material()));
+        } else {
+            scene.addObject(std::make_shared<Cylinder>(p, Direction(0, 1, 0), s, 2 * s, Material()));
+        }
+    }
+
+    std::uniform_real_distribution<float> jitter(-0.3f, 0.3f);
+    for (int packetIndex = 0; packetIndex < 200; packetIndex++) {
+        // Half of the packets are camera-like (shared origin), the rest are random rays
+        bool coherent = packetIndex % 2 == 0;
+        int count = 1 + packetIndex % RayPacket::MAX_RAYS;
+        Point origin(pos(gen), pos(gen), -5);
+        Direction axis(jitter(gen), jitter(gen), 1);
+        std::vector<Ray> rays;
+        for (int i = 0; i < count; i++) {
+            if (coherent) {
+                rays.emplace_back(origin, axis + Direction(jitter(gen), jitter(gen), 0));
+            } else {
+                rays.emplace_back(Point(pos(gen), pos(gen), pos(gen)), Direction(pos(gen), pos(gen), pos(gen)));
+            }
+        }
+
+        RayPacket packet(rays.data(), count);
+        PacketHits hits(1000.0f);
+        scene.closestHitPacket(packet, hits);
+        for (int i = 0; i < count; i++) {
+            auto expected = scene.closestHit(rays[i]);
+            auto actual = hits.hit(i);
+            assert(expected.has_value() == actual.has_value());
+            if (expected) {
+                assert(expected->distance == actual->distance);
+                assert(expected->primitiveId == actual->primitiveId);
+                assert(expected->elementId == actual->elementId);
+            }
+        }
+    }
+    std::cout << "Packet intersection test passed!" << std::endl;
+}
+
+// OBJ, ASCII PLY and binary PLY versions of the same unit quad, and a scene that loads one
+void test_mesh_loader() {
+    namespace fs = std::filesystem;
+    fs::path dir = fs::temp_directory_path() / "mesh_loader_test";
+    fs::create_directories(dir);
+
+    {
+        std::ofstream obj(dir / "quad.obj");
+        obj << "# quad\nv 0 0 0\nv 1 0 0\nvt 0 0\nv 1 1 0\nv 0 1 0\r\n"
+            << "f 1/1/1 2/1/1 3/1/1 -1/1/1\n";
+    }
+    {
+        std::ofstream ply(dir / "quad_ascii.ply");
+        ply << "ply\nformat ascii 1.0\nelement vertex 4\nproperty float x\nproperty float y\n"
+            << "property float z\nelement face 1\nproperty list uchar int vertex_indices\nend_header\n"
+            << "0 0 0\n1 0 0\n1 1 0\n0 1 0\n4 0 1 2 3\n";
+    }
+    {
+        std::ofstream ply(dir / "quad.ply", std::ios::binary);
+        ply << "ply\nformat binary_little_endian 1.0\ncomment extra property\nelement vertex 4\n"
+            << "property float x\nproperty float y\nproperty float z\nproperty uchar red\n"
+            << "element face 1\nproperty list uchar uint vertex_indices\nend_header\n";
+        float vertices[4][3] = {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0}};
+        for (auto& v : vertices) {
+            ply.write(reinterpret_cast<const char*>(v), sizeof(v));
+            ply.put(char(255));
+        }
+        uint32_t face[4] = {0, 1, 2, 3};
+        ply.put(char(4));
+        ply.write(reinterpret_cast<const char*>(face), sizeof(face));
+    }
+
+    for (const char* name : {"quad.obj", "quad_ascii.ply", "quad.ply"}) {
+        auto mesh = loadMesh((dir / name).string());
+        assert(mesh.has_value());
+        assert(mesh->positions.size() == 12);
+        assert((mesh->indices == std::vector<uint32_t>{0, 1, 2, 0, 2, 3}));
+        assert(mesh->positions[6] == 1 && mesh->positions[7] == 1);
+    }
+    assert(!loadMesh((dir / "missing.ply").string()).has_value());
+
+    {
+        std::ofstream yaml(dir / "scene.txt");
+        yaml << "material: 0.8 0.2 0.2\nmesh: quad.ply\n";
+    }
+    Scene scene = Scene::fromYAML((dir / "scene.txt").string());
+    assert(scene.objects.size() == 1);
+    auto hit = scene.intersect(Ray(Point(0.75, 0.25, -1), Direction(0, 0, 1)));
+    assert(hit.has_value() && abs(hit->distance - 1.0f) < EPSILON);
+
+    fs::remove_all(dir);
+    std::cout << "Mesh loader test passed!" << std::endl;
+}
+
 void run_intersect_tests() {
     std::cout << "Running intersect tests...\n";
     test_sphere_intersection();
@@ -55,4 +433,12 @@ void run_intersect_tests() {
     test_triangle_intersection();
     test_cone_intersection();
     test_cylinder_intersection();
+    test_bvh_intersection();
+    test_bvh_depth_limit();
+    test_material_table();
+    test_triangle_mesh();
+    test_mesh_depth_limit();
+    test_packet_intersection();
+    test_packet_depth_limit();
+    test_mesh_loader();
 }
@@ -21,18 +21,22 @@ void run_cornell_box_test();
 void run_bmp_tests();
 void run_geometry_tests();
 void run_intersect_tests();
+void run_photon_tests();
 // Add more test group declarations as needed
 
 void print_usage(const char* prog) {
-    std::cout << "Usage: " << prog << " [all|p2|parallel|cornell_box|bmp|geometry|intersect|...]\n";
+    std::cout << "Usage: " << prog << " [all|p2|parallel|cornell_box|bmp|geometry|intersect|photon|...]\n";
     std::cout << "Available tests:\n";
     std::cout << "  all          - Run all tests\n";
     std::cout << "  p2           - Run P2 (image/tone mapping) tests\n";
     std::cout << "  parallel     - Run parallel rendering tests\n";
+    std::cout << "  parallel_bench - Queue, thread pool, tile order and scaling benchmarks (not part of all)\n";
     std::cout << "  cornell_box  - Run Cornell Box scene test\n";
     std::cout << "  bmp          - Run BMP read/write tests\n";
     std::cout << "  geometry     - Run geometry tests\n";
     std::cout << "  intersect    - Run intersection tests\n";
+    std::cout << "  photon       - Run photon map tests\n";
+    std::cout << "  photon_bench - Photon mapping render time from 10k to 10M photons (not part of all)\n";
     // List more test groups here
 }
 
@@ -84,6 +88,22 @@ int main(int argc, char* argv[]) {
             ran = true;
             if (!run_all && arg != "all") { if (!run_all) break; }
         }
+        if (run_all || arg == "photon") {
+            std::cout << "Running photon map tests...\n";
+            run_photon_tests();
+            ran = true;
+            if (!run_all && arg != "all") { if (!run_all) break; }
+        }
+        if (arg == "photon_bench") {
+            run_photon_benchmark();
+            ran = true;
+            if (!run_all) break;
+        }
+        if (arg == "parallel_bench") {
+            run_parallel_benchmark();
+            ran = true;
+            if (!run_all) break;
+        }
         // Add more test group checks here
     }
 
@@ -100,13 +120,15 @@ int main(int argc, char* argv[]) {
         run_geometry_tests();
         std::cout << "Running intersect tests...\n";
         run_intersect_tests();
+        std::cout << "Running photon map tests...\n";
+        run_photon_tests();
         ran = true;
     }
 
     if (!ran && !args.empty() && args[0] != "all") {
         bool known_arg = false;
         for (const auto& arg : args) {
-            if (arg == "p2" || arg == "parallel" || arg == "cornell_box" || arg == "bmp" || arg == "geometry" || arg == "intersect") {
+            if (arg == "p2" || arg == "parallel" || arg == "cornell_box" || arg == "bmp" || arg == "geometry" || arg == "intersect" || arg == "photon" || arg == "photon_bench" || arg == "parallel_bench") {
                 known_arg = true;
                 break;
             }
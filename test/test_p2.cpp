@@ -2,6 +2,7 @@
 #include <cassert>
 #include <string>
 #include <iomanip>
+#include <fstream>
 #include "../include/Image.hpp"
 #include "../include/toneMapping.hpp"
 
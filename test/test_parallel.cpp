@@ -5,11 +5,22 @@
 #include <ctime>
 #include <iomanip>
 #include <sstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
 
 #include "../include/object3D.hpp"
 #include "../include/pinholeCamera.hpp"
 #include "../include/parallel_renderer.hpp"
 #include "../include/Image.hpp"
+#include "../include/adaptive_sampler.hpp"
+#include "../include/progressive_renderer.hpp"
+#include "../include/cpu_topology.hpp"
+#include "test.hpp"
 
 using namespace std;
 
@@ -23,16 +34,380 @@ std::string getTimestampedFilename(const std::string& base, const std::string& e
     return oss.str();
 }
 
-void run_parallel_tests(int argc, char* argv[]) {
-    // Default values
-    unsigned samples = 16;
-    int width = 256, height = 256;
-    std::string outputBase = "parallel_test_output";
-    if (argc > 1) samples = std::stoi(argv[1]);
-    if (argc > 3) { width = std::stoi(argv[2]); height = std::stoi(argv[3]); }
-    if (argc > 4) outputBase = argv[4];
+// Every task pushed into a queue must be popped exactly once across all workers
+void test_task_queue(QueueType type, const std::string& name) {
+    const int numThreads = 4;
+    const int width = 64, height = 48;
+    RenderConfig config;
+    config.regionType = RegionType::PIXEL;
+    auto tasks = TaskGenerator::generateTasks(width, height, config);
 
-    // Create a simple test scene
+    auto queue = QueueFactory::createQueue(type, numThreads);
+    for (const auto& t : tasks) queue->push(t);
+    queue->finish();
+
+    std::vector<std::atomic<int>> seen(tasks.size());
+    std::vector<std::thread> workers;
+    for (int i = 0; i < numThreads; ++i) {
+        workers.emplace_back([&, i]() {
+            RenderTask task;
+            while (queue->pop(task, i)) seen[task.taskId]++;
+        });
+    }
+    for (auto& w : workers) w.join();
+
+    for (const auto& count : seen) assert(count.load() == 1);
+    assert(queue->empty());
+    cout << name << " queue test passed!" << endl;
+}
+
+// Every index of every job runs exactly once, and renders reuse the same threads
+void test_thread_pool() {
+    ThreadPool pool(2);
+    std::vector<std::atomic<int>> first(6), second(3);
+    auto a = pool.submit(6, [&](int i) { first[i]++; });
+    auto b = pool.submit(3, [&](int i) { second[i]++; });
+    pool.wait(b);
+    pool.wait(a);
+    for (const auto& count : first) assert(count.load() == 1);
+    for (const auto& count : second) assert(count.load() == 1);
+    assert(pool.size() == 5);   // Grown to parallelism - 1, the waiting thread is the last worker
+
+    // An index that throws still lets the rest finish, and wait rethrows
+    std::atomic<int> finished{0};
+    bool caught = false;
+    try {
+        pool.run(4, [&](int i) {
+            if (i == 2) throw std::runtime_error("index 2");
+            finished++;
+        });
+    } catch (const std::runtime_error&) {
+        caught = true;
+    }
+    assert(caught && finished.load() == 3);
+
+    Scene scene = buildSphereScene();
+    PinholeCamera camera(Point(0, 0, -2.5), 35, 16, 16);
+    RenderConfig config(RenderingAlgorithm::RAY_TRACING);
+    config.numThreads = 3;
+    ParallelRenderer renderer(config, &pool);
+    Image reference = renderer.render(camera, scene, 1, config);
+    for (int i = 0; i < 20; i++) {
+        Image image = renderer.render(camera, scene, 1, config);
+        for (size_t p = 0; p < image.pixels.size(); p++) assert(image.pixels[p].r == reference.pixels[p].r);
+    }
+    assert(pool.size() == 5);
+    cout << "Thread pool test passed!" << endl;
+}
+
+// Guided splits cover each pixel once, never go below the minimum and do not change the image
+void test_guided_scheduling() {
+    const int width = 64, height = 64, numWorkers = 4;
+    RenderConfig config;
+    config.regionType = RegionType::RECTANGLE;
+    config.regionSize = 32;
+    auto tasks = TaskGenerator::generateTasks(width, height, config);
+
+    GuidedTaskQueue queue(numWorkers, 4);
+    for (const auto& t : tasks) queue.push(t);
+    queue.finish();
+    std::vector<int> covered(width * height, 0);
+    std::vector<bool> ids(1024, false);
+    RenderTask task;
+    int popped = 0;
+    while (queue.pop(task)) {
+        popped++;
+        assert(!ids[task.taskId]);
+        ids[task.taskId] = true;
+        assert(task.endX - task.startX >= 4 && task.endY - task.startY >= 4);
+        for (int y = task.startY; y < task.endY; y++)
+            for (int x = task.startX; x < task.endX; x++) covered[y * width + x]++;
+    }
+    for (int c : covered) assert(c == 1);
+    assert(popped > int(tasks.size()));
+
+    Scene scene = buildSphereScene();
+    PinholeCamera camera(Point(0, 0, -2.5), 35, width, height);
+    config.numThreads = numWorkers;
+    Image reference = camera.render(scene, 2, config);
+
+    config.queueType = QueueType::GUIDED;
+    ParallelRenderer renderer(config);
+    Image image = renderer.render(camera, scene, 2, config);
+    for (size_t i = 0; i < image.pixels.size(); i++) assert(image.pixels[i].r == reference.pixels[i].r);
+    auto stats = renderer.getLastRenderStats();
+    assert(stats.numTasks > int(tasks.size()));
+    assert(int(stats.idleTime.size()) == numWorkers);
+    cout << "Guided scheduling test passed! (" << tasks.size() << " tiles rendered as " << stats.numTasks << ")" << endl;
+}
+
+// Tiles reach the framebuffer whole, and the hook sees every one of them with the final pixels
+void test_tile_hook() {
+    const int width = 40, height = 24;
+    Scene scene = buildSphereScene(true);
+    PinholeCamera camera(Point(0, 0, -2.5), 35, width, height);
+
+    RenderConfig sequential(RenderingAlgorithm::PATH_TRACING, RenderingMode::SEQUENTIAL);
+    Image reference = camera.render(scene, 2, sequential);
+
+    for (RegionType region : {RegionType::COLUMN, RegionType::PIXEL, RegionType::RECTANGLE}) {
+        RenderConfig config(RenderingAlgorithm::PATH_TRACING);
+        config.regionType = region;
+        config.regionSize = region == RegionType::RECTANGLE ? 7 : 1;
+        config.numThreads = 3;
+
+        std::mutex mutex;
+        std::vector<RGB> streamed(width * height);
+        size_t calls = 0, lastDone = 0;
+        ParallelRenderer renderer(config);
+        renderer.setTileHook([&](const RenderTask& task, const TileView& tile, size_t done, size_t total) {
+            std::lock_guard<std::mutex> lock(mutex);
+            assert(total == size_t(width * height));
+            for (int y = task.startY; y < task.endY; y++)
+                for (int x = task.startX; x < task.endX; x++) streamed[y * width + x] = tile.at(x, y);
+            calls++;
+            lastDone = std::max(lastDone, done);
+        });
+        Image image = renderer.render(camera, scene, 2, config);
+
+        assert(calls == size_t(renderer.getLastRenderStats().numTasks));
+        assert(lastDone == size_t(width * height));
+        for (size_t i = 0; i < image.pixels.size(); i++) {
+            assert(image.pixels[i].r == reference.pixels[i].r && streamed[i].r == reference.pixels[i].r);
+            assert(image.pixels[i].g == reference.pixels[i].g && streamed[i].g == reference.pixels[i].g);
+            assert(image.pixels[i].b == reference.pixels[i].b && streamed[i].b == reference.pixels[i].b);
+        }
+    }
+    cout << "Tile buffer hook test passed!" << endl;
+}
+
+// Topology read from a fake two-socket sysfs tree, and pinned renders that match free ones
+void test_cpu_affinity() {
+    namespace fs = std::filesystem;
+    fs::path root = fs::temp_directory_path() / "topology_test";
+    fs::remove_all(root);
+    auto write = [](const fs::path& path, const std::string& text) {
+        fs::create_directories(path.parent_path());
+        std::ofstream(path) << text << "\n";
+    };
+    // Two sockets, two cores each, two threads per core: cpu N and N + 2 are siblings
+    write(root / "cpu" / "online", "0-7");
+    for (int cpu = 0; cpu < 8; cpu++) {
+        fs::path dir = root / "cpu" / ("cpu" + to_string(cpu)) / "topology";
+        write(dir / "physical_package_id", to_string(cpu / 4));
+        write(dir / "core_id", to_string(cpu % 2));
+    }
+    write(root / "node" / "node0" / "cpulist", "0-3");
+    write(root / "node" / "node1" / "cpulist", "4-7");
+
+    CpuTopology topology = CpuTopology::discover(root.string());
+    assert(topology.cpus.size() == 8 && topology.numNodes == 2);
+    assert(topology.nodeOf(2) == 0 && topology.nodeOf(5) == 1);
+    assert((topology.placement(2) == std::vector<int>{0, 4}));          // One per node
+    assert((topology.placement(4) == std::vector<int>{0, 1, 4, 5}));    // One per core
+    assert(topology.placement(16).size() == 16);
+    fs::remove_all(root);
+
+    // Stealing restricted to the node first still hands out every task once
+    RenderConfig pixels;
+    pixels.regionType = RegionType::PIXEL;
+    auto tasks = TaskGenerator::generateTasks(32, 32, pixels);
+    WorkStealingTaskQueue queue(4);
+    queue.setWorkerNodes({0, 0, 1, 1});
+    for (const auto& t : tasks) queue.push(t);
+    queue.finish();
+    std::vector<int> seen(tasks.size(), 0);
+    RenderTask task;
+    while (queue.pop(task, 3)) seen[task.taskId]++;
+    for (int count : seen) assert(count == 1);
+
+    cpu_set_t before, after;
+    pthread_getaffinity_np(pthread_self(), sizeof(before), &before);
+    {
+        ScopedAffinity pin(CpuTopology::system().cpus[0].id);
+        assert(pin.pinned());
+    }
+    pthread_getaffinity_np(pthread_self(), sizeof(after), &after);
+    assert(CPU_EQUAL(&before, &after));
+
+    // Released pages read as zeros and take new writes like any other memory
+    std::vector<RGB> buffer(1 << 16, RGB(1, 1, 1));
+    assert(releasePages(buffer.data(), buffer.size() * sizeof(RGB)));
+    assert(buffer[buffer.size() / 2].r == 0);
+    buffer[buffer.size() / 2] = RGB(2, 2, 2);
+    assert(buffer[buffer.size() / 2].g == 2);
+
+    Scene scene = buildSphereScene();
+    PinholeCamera camera(Point(0, 0, -2.5), 35, 24, 24);
+    // Pinning changes where pixels live, never their values, with any queue
+    for (QueueType queue : {QueueType::WORK_STEALING, QueueType::STD_QUEUE, QueueType::GUIDED}) {
+        RenderConfig config(RenderingAlgorithm::PATH_TRACING);
+        config.queueType = queue;
+        config.regionType = RegionType::RECTANGLE;
+        config.numThreads = 3;
+        Image free = camera.render(scene, 2, config);
+        config.pinThreads = true;
+        Image pinned = camera.render(scene, 2, config);
+        for (size_t i = 0; i < free.pixels.size(); i++) assert(free.pixels[i].r == pinned.pixels[i].r);
+    }
+
+    cout << "CPU affinity test passed!" << endl;
+}
+
+// Curve orders cover every pixel once; Hilbert steps to a neighbour, spiral starts at the centre
+void test_tile_orders() {
+    for (RegionType order : {RegionType::HILBERT, RegionType::MORTON, RegionType::SPIRAL}) {
+        for (auto [width, height] : {std::pair{64, 64}, std::pair{100, 37}}) {
+            RenderConfig config;
+            config.regionType = order;
+            config.regionSize = 8;
+            auto tasks = TaskGenerator::generateTasks(width, height, config);
+
+            std::vector<int> covered(width * height, 0);
+            for (size_t i = 0; i < tasks.size(); i++) {
+                assert(tasks[i].taskId == int(i));
+                for (int y = tasks[i].startY; y < tasks[i].endY; y++)
+                    for (int x = tasks[i].startX; x < tasks[i].endX; x++) covered[y * width + x]++;
+            }
+            for (int c : covered) assert(c == 1);
+
+            if (order == RegionType::HILBERT && width == 64) {
+                for (size_t i = 1; i < tasks.size(); i++) {
+                    int step = abs(tasks[i].startX - tasks[i - 1].startX) + abs(tasks[i].startY - tasks[i - 1].startY);
+                    assert(step == 8);
+                }
+            }
+            if (order == RegionType::SPIRAL) {
+                int cx = width / 2, cy = height / 2;
+                assert(abs(tasks[0].startX + 4 - cx) <= 8 && abs(tasks[0].startY + 4 - cy) <= 8);
+            }
+        }
+    }
+    cout << "Tile order test passed!" << endl;
+}
+
+// Same seed must give the same image bit for bit, whatever the thread count
+void test_parallel_determinism() {
+    Scene scene = buildSphereScene(true);
+    PinholeCamera camera(Point(0, 0, -2.5), 35, 32, 32);
+
+    RenderConfig sequential(RenderingAlgorithm::PATH_TRACING, RenderingMode::SEQUENTIAL);
+    sequential.seed = 42;
+    Image reference = camera.render(scene, 4, sequential);
+
+    for (int threads : {1, 3}) {
+        RenderConfig parallel(RenderingAlgorithm::PATH_TRACING);
+        parallel.seed = 42;
+        parallel.numThreads = threads;
+        parallel.regionType = RegionType::PIXEL;
+        parallel.queueType = QueueType::WORK_STEALING;
+        Image image = camera.render(scene, 4, parallel);
+        for (size_t i = 0; i < image.pixels.size(); i++) {
+            assert(image.pixels[i].r == reference.pixels[i].r);
+            assert(image.pixels[i].g == reference.pixels[i].g);
+            assert(image.pixels[i].b == reference.pixels[i].b);
+        }
+    }
+    cout << "Parallel determinism test passed!" << endl;
+}
+
+// Flat pixels stop early, the budget is never exceeded and threads do not change the image
+void test_adaptive_sampling() {
+    Scene scene = buildSphereScene();
+    PinholeCamera camera(Point(0, 0, -2.5), 35, 32, 32);
+    const unsigned spp = 16;
+
+    RenderConfig sequential(RenderingAlgorithm::PATH_TRACING, RenderingMode::SEQUENTIAL);
+    sequential.seed = 7;
+    sequential.adaptiveSampling = true;
+    sequential.adaptiveMinSamples = 4;
+    AdaptiveSampler::Result reference = AdaptiveSampler::render(camera, scene, spp, sequential);
+
+    size_t total = 0;
+    unsigned most = 0;
+    for (unsigned s : reference.samples) {
+        total += s;
+        most = max(most, s);
+    }
+    assert(total <= size_t(32 * 32) * spp);
+    assert(most > spp);                        // The sphere took part of the background's budget
+    assert(reference.samples[0] == 4);         // The corner sees only background
+    assert(reference.heatmap.width == 32 && reference.heatmap.height == 32);
+    assert(reference.heatmap.pixels.size() == reference.samples.size());
+
+    for (int threads : {1, 3}) {
+        RenderConfig parallel = sequential;
+        parallel.mode = RenderingMode::PARALLEL;
+        parallel.numThreads = threads;
+        parallel.regionType = RegionType::RECTANGLE;
+        // Through the camera and straight through the parallel renderer
+        for (const Image& image : {camera.render(scene, spp, parallel),
+                                   ParallelRenderer(parallel).render(camera, scene, spp, parallel)}) {
+            for (size_t i = 0; i < image.pixels.size(); i++) {
+                assert(image.pixels[i].r == reference.image.pixels[i].r);
+                assert(image.pixels[i].g == reference.image.pixels[i].g);
+                assert(image.pixels[i].b == reference.image.pixels[i].b);
+            }
+        }
+    }
+    cout << "Adaptive sampling test passed! (" << total << " of " << 32 * 32 * spp
+         << " samples, at most " << most << " in a pixel)" << endl;
+}
+
+// A render stopped after some passes and resumed from its checkpoint ends with the same image
+void test_progressive_resume() {
+    namespace fs = std::filesystem;
+    fs::path dir = fs::temp_directory_path() / "progressive_test";
+    fs::create_directories(dir);
+    std::string checkpoint = (dir / "render.acc").string();
+    std::string preview = (dir / "preview.ppm").string();
+    fs::remove(checkpoint);
+
+    Scene scene = buildSphereScene(true);
+    PinholeCamera camera(Point(0, 0, -2.5), 35, 24, 16);
+
+    RenderConfig config(RenderingAlgorithm::PATH_TRACING);
+    config.seed = 3;
+    config.numThreads = 2;
+
+    ProgressiveRenderer::Settings settings;
+    settings.samplesPerPass = 2;
+    settings.passes = 4;
+    Image uninterrupted = ProgressiveRenderer(camera, scene, config).render(settings);
+
+    // First job is preempted after two passes
+    settings.passes = 2;
+    settings.checkpointPath = checkpoint;
+    settings.previewPath = preview;
+    ProgressiveRenderer(camera, scene, config).render(settings);
+    assert(fs::exists(checkpoint) && fs::exists(preview));
+
+    auto saved = AccumulationBuffer::load(checkpoint);
+    assert(saved && saved->passes == 2 && saved->counts[0] == 4);
+    assert(saved->matches(24, 16, config, 2) && !saved->matches(24, 16, config, 1));
+    RenderConfig sobol = config;
+    sobol.sampler = SamplerType::SOBOL;
+    RenderConfig deeper = config;
+    deeper.maxDepth++;
+    assert(!saved->matches(24, 16, sobol, 2) && !saved->matches(24, 16, deeper, 2));
+
+    // Second job picks it up
+    settings.passes = 4;
+    ProgressiveRenderer resumed(camera, scene, config);
+    Image image = resumed.render(settings);
+    assert(resumed.buffer().passes == 4 && resumed.buffer().counts[0] == 8);
+    for (size_t i = 0; i < image.pixels.size(); i++) {
+        assert(image.pixels[i].r == uninterrupted.pixels[i].r);
+        assert(image.pixels[i].g == uninterrupted.pixels[i].g);
+        assert(image.pixels[i].b == uninterrupted.pixels[i].b);
+    }
+
+    fs::remove_all(dir);
+    cout << "Progressive resume test passed!" << endl;
+}
+
+// Scene of the parallel rendering performance test and of the parallel benchmarks
+static Scene buildPerformanceScene() {
     Scene scene;
     
     // Materials
@@ -49,6 +424,33 @@ void run_parallel_tests(int argc, char* argv[]) {
     
     // Light
     scene.addLight(make_shared<PointLight>(Point(0, 0.8, 0), RGB(2, 2, 2)));
+    return scene;
+}
+
+void run_parallel_tests(int argc, char* argv[]) {
+    test_task_queue(QueueType::STD_QUEUE, "Standard");
+    test_task_queue(QueueType::LOCK_FREE_QUEUE, "Lock-free");
+    test_task_queue(QueueType::WORK_STEALING, "Work-stealing");
+    test_task_queue(QueueType::GUIDED, "Guided");
+    test_guided_scheduling();
+    test_thread_pool();
+    test_tile_orders();
+    test_tile_hook();
+    test_cpu_affinity();
+    test_parallel_determinism();
+    test_adaptive_sampling();
+    test_progressive_resume();
+
+    // Default values
+    unsigned samples = 16;
+    int width = 256, height = 256;
+    std::string outputBase = "parallel_test_output";
+    if (argc > 1) samples = std::stoi(argv[1]);
+    if (argc > 3) { width = std::stoi(argv[2]); height = std::stoi(argv[3]); }
+    if (argc > 4) outputBase = argv[4];
+
+    // Create a simple test scene
+    Scene scene = buildPerformanceScene();
     
     // Camera (smaller resolution for faster testing)
     PinholeCamera camera(Point(0, 0, -2.5), 35, width, height);
@@ -75,6 +477,9 @@ void run_parallel_tests(int argc, char* argv[]) {
         [](){ RenderConfig c; c.regionType=RegionType::LINE; c.regionSize=4; c.numThreads=4; return c; }(),
         [](){ RenderConfig c; c.regionType=RegionType::LINE; c.regionSize=16; c.numThreads=4; return c; }(),
         [](){ RenderConfig c; c.regionType=RegionType::COLUMN; c.regionSize=4; c.numThreads=4; return c; }(),
+        [](){ RenderConfig c; c.regionType=RegionType::HILBERT; c.regionSize=16; c.numThreads=4; return c; }(),
+        [](){ RenderConfig c; c.regionType=RegionType::MORTON; c.regionSize=16; c.numThreads=4; return c; }(),
+        [](){ RenderConfig c; c.regionType=RegionType::SPIRAL; c.regionSize=16; c.numThreads=4; return c; }(),
     };
     
     cout << "Testing parallel configurations:\n";
@@ -88,7 +493,9 @@ void run_parallel_tests(int argc, char* argv[]) {
         const auto& config = configs[i];
         ParallelRenderer renderer(config);
         auto start = chrono::high_resolution_clock::now();
-        Image parallelImage = renderer.render(camera, scene, samples, RenderConfig());
+        // render takes its settings from the config argument, not from the constructor:
+        // the region and thread count printed below must be the ones passed here
+        Image parallelImage = renderer.render(camera, scene, samples, config);
         auto end = chrono::high_resolution_clock::now();
         auto parallelTime = chrono::duration_cast<chrono::milliseconds>(end - start);
         double timeSeconds = parallelTime.count() / 1000.0;
@@ -100,6 +507,9 @@ void run_parallel_tests(int argc, char* argv[]) {
             case RegionType::LINE: regionName = "LINE "; break;
             case RegionType::COLUMN: regionName = "COLUMN"; break;
             case RegionType::RECTANGLE: regionName = "RECT"; break;
+            case RegionType::HILBERT: regionName = "HILBERT"; break;
+            case RegionType::MORTON: regionName = "MORTON"; break;
+            case RegionType::SPIRAL: regionName = "SPIRAL"; break;
         }
         
         cout << left << setw(15) << (regionName + "(" + to_string(config.regionSize) + ")")
@@ -123,3 +533,35 @@ void run_parallel_tests(int argc, char* argv[]) {
     cout << "\nTest completed! Check " << parallelOutput << " and " << sequentialOutput << std::endl;
     cout << "Images should look identical (parallel should match sequential)\n";
 }
+
+// Queue, thread pool, tile order and scaling benchmarks. They take minutes and only
+// print timings, so they are not part of the parallel tests
+void run_parallel_benchmark() {
+    const unsigned samples = 16;
+    Scene scene = buildPerformanceScene();
+    PinholeCamera camera(Point(0, 0, -2.5), 35, 256, 256);
+
+    RenderBenchmark::benchmarkQueues(256, 256, {1, 2, 4, 8, 16, 32, 64});
+    RenderBenchmark::benchmarkThreadPool(4);
+
+    // Tile orders and schedules side by side, with idle time and cache misses where perf events are available
+    vector<RenderConfig> orders;
+    for (RegionType order : {RegionType::RECTANGLE, RegionType::HILBERT, RegionType::MORTON, RegionType::SPIRAL}) {
+        RenderConfig c;
+        c.regionType = order;
+        c.regionSize = 16;
+        c.numThreads = 4;
+        orders.push_back(c);
+    }
+    // Large tiles with and without guided splitting
+    for (QueueType queue : {QueueType::STD_QUEUE, QueueType::GUIDED}) {
+        RenderConfig c;
+        c.regionType = RegionType::RECTANGLE;
+        c.regionSize = 128;
+        c.numThreads = 4;
+        c.queueType = queue;
+        orders.push_back(c);
+    }
+    RenderBenchmark::benchmarkConfigurations(camera, scene, orders, samples);
+    RenderBenchmark::benchmarkScaling(camera, scene, samples);
+}
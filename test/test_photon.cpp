@@ -0,0 +1,388 @@
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include "../include/foton.hpp"
+#include "../include/kernel.hpp"
+#include "../include/object3D.hpp"
+#include "../include/pinholeCamera.hpp"
+#include "test.hpp"
+
+namespace {
+    std::vector<FotonEmitido> fotonesAleatorios(int n, uint32_t seed) {
+        std::mt19937 gen(seed);
+        std::uniform_real_distribution<float> pos(-1.0f, 1.0f);
+        std::vector<FotonEmitido> fotones;
+        fotones.reserve(n);
+        for (int i = 0; i < n; i++) {
+            // Half of the photons on a plane, like the photons of a floor
+            float y = i % 2 == 0 ? -1.0f : pos(gen);
+            fotones.emplace_back(Point(pos(gen), y, pos(gen)), Direction(0, -1, 0), RGB(1, 1, 1));
+        }
+        return fotones;
+    }
+
+    float distance(const Point& a, const Point& b) {
+        float dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+        return std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+
+    // Distance from the query to every photon found, sorted
+    std::vector<float> distances(const MapaFotones& mapa, const std::vector<const Foton*>& found, const Point& p) {
+        std::vector<float> d;
+        for (const Foton* f : found) d.push_back(distance(mapa.posicion(f), p));
+        std::sort(d.begin(), d.end());
+        return d;
+    }
+}
+
+// The tree built with several threads answers like the sequential one and like a brute force search
+void test_kdtree_parallel_build() {
+    const int N = 200000;
+    std::vector<FotonEmitido> todos = fotonesAleatorios(N, 7);
+
+    MapaFotones secuencial = construirMapaFotones(std::vector<FotonEmitido>(todos), 1);
+    std::vector<FotonEmitido> copia(todos);
+    MapaFotones paralelo = construirMapaFotones(std::move(copia), 4);
+    assert(secuencial.size() == size_t(N) && paralelo.size() == size_t(N));
+
+    // The map consumes the emitted photons and keeps each position once, in its arrays
+    assert(copia.capacity() == 0);
+    assert(paralelo.memoryUsage() == N * (sizeof(Foton) + 3 * sizeof(float) + 1));
+
+    std::mt19937 gen(11);
+    std::uniform_real_distribution<float> pos(-1.2f, 1.2f);
+    for (int q = 0; q < 200; q++) {
+        Point p(pos(gen), q % 2 == 0 ? -1.0f : pos(gen), pos(gen));
+        const std::size_t k = 20;
+        const float radio = 0.1f;
+
+        std::vector<float> esperado;
+        for (const FotonEmitido& f : todos) {
+            float d = distance(f.posicion(), p);
+            if (d < radio) esperado.push_back(d);
+        }
+        std::sort(esperado.begin(), esperado.end());
+        if (esperado.size() > k) esperado.resize(k);
+
+        assert(distances(secuencial, secuencial.nearest_neighbors(p, k, radio), p) == esperado);
+        assert(distances(paralelo, paralelo.nearest_neighbors(p, k, radio), p) == esperado);
+    }
+
+    std::cout << "Photon map build (" << N << " photons): " << secuencial.build_time() * 1000.0
+              << " ms with 1 thread, " << paralelo.build_time() * 1000.0 << " ms with 4 threads, "
+              << paralelo.memoryUsage() / N << " bytes per photon\n";
+    std::cout << "KD-tree parallel build test passed!" << std::endl;
+}
+
+// Packing keeps the position exact, the direction within 1e-3 and the flux within 1/256 of its largest channel
+void test_foton_compacto() {
+    assert(sizeof(Foton) == 8 && sizeof(FotonEmitido) == 20);
+    std::mt19937 gen(3);
+    std::uniform_real_distribution<float> u(-1.0f, 1.0f), e(-30.0f, 30.0f);
+    for (int i = 0; i < 10000; i++) {
+        Point p(u(gen) * 100, u(gen), u(gen));
+        Direction d = Direction(u(gen), u(gen), u(gen)).normalize();
+        if (i < 6) d = Direction(i == 0 ? 1 : i == 1 ? -1 : 0, i == 2 ? 1 : i == 3 ? -1 : 0, i == 4 ? 1 : i == 5 ? -1 : 0);
+        float scale = std::exp2(e(gen));
+        RGB f((u(gen) + 1) * scale, (u(gen) + 1) * scale, (u(gen) + 1) * scale);
+
+        FotonEmitido emitido(p, d, f);
+        Point q = emitido.posicion();
+        assert(q.x == p.x && q.y == p.y && q.z == p.z);
+        assert((emitido.foton.direccion() - d).mod() < 1e-3f);
+        RGB g = emitido.foton.flujo();
+        float tolerance = std::max(f.r, std::max(f.g, f.b)) / 256.0f;
+        assert(std::abs(g.r - f.r) <= tolerance && std::abs(g.g - f.g) <= tolerance && std::abs(g.b - f.b) <= tolerance);
+    }
+    Foton negro(Direction(0, 0, 1), RGB(0, 0, 0));
+    assert(negro.flujo().r == 0 && negro.flujo().g == 0 && negro.flujo().b == 0);
+    std::cout << "Compact photon test passed!" << std::endl;
+}
+
+// The buffer query finds the brute force neighbours and reports the squared distance of the farthest
+void test_busqueda_fotones() {
+    const int N = 50000;
+    std::vector<FotonEmitido> todos = fotonesAleatorios(N, 5);
+    MapaFotones mapa = construirMapaFotones(std::vector<FotonEmitido>(todos), 1);
+
+    std::mt19937 gen(13);
+    std::uniform_real_distribution<float> pos(-1.2f, 1.2f);
+    FotonCercano vecinos[32];
+    for (int q = 0; q < 200; q++) {
+        Point p(pos(gen), pos(gen), pos(gen));
+        float radio = q % 3 == 0 ? std::numeric_limits<float>::infinity() : 0.15f;
+        std::size_t k = 1 + q % 32;
+
+        std::vector<float> esperado;
+        for (const FotonEmitido& f : todos) {
+            float dx = p.x - f.pos[0], dy = p.y - f.pos[1], dz = p.z - f.pos[2];
+            float d2 = dx * dx + dy * dy + dz * dz;
+            if (d2 < radio * radio) esperado.push_back(d2);
+        }
+        std::sort(esperado.begin(), esperado.end());
+
+        // Sin máximo de vecinos salen todos los del radio
+        if (std::isfinite(radio)) {
+            std::vector<FotonCercano> todosEnRadio;
+            BusquedaFotones enRadio = mapa.en_radio(p, radio, todosEnRadio);
+            assert(enRadio.encontrados == esperado.size() && enRadio.radio2 == radio * radio);
+            std::vector<float> obtenido;
+            for (const FotonCercano& v : todosEnRadio) obtenido.push_back(v.distance2);
+            std::sort(obtenido.begin(), obtenido.end());
+            assert(obtenido == esperado);
+        }
+        if (esperado.size() > k) esperado.resize(k);
+
+        BusquedaFotones busqueda = mapa.nearest_neighbors(p, radio, std::span(vecinos, k));
+        assert(busqueda.encontrados == esperado.size());
+        assert(busqueda.radio2 == (esperado.empty() ? 0.0f : esperado.back()));
+
+        std::vector<float> obtenido;
+        for (std::size_t i = 0; i < busqueda.encontrados; i++) {
+            assert(vecinos[i].distance2 <= vecinos[0].distance2);
+            obtenido.push_back(vecinos[i].distance2);
+        }
+        std::sort(obtenido.begin(), obtenido.end());
+        assert(obtenido == esperado);
+    }
+    std::cout << "Photon buffer query test passed!" << std::endl;
+}
+
+// Photon paths traced with several threads give the same map as with one
+void test_emision_paralela() {
+    Scene scene = buildCornellBox();
+    const int paseos = 5000;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    MapaFotones uno = scene.generarMapaFotones(paseos, false, 0.0, 3, 1);
+    double secuencial = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    start = std::chrono::high_resolution_clock::now();
+    MapaFotones cuatro = scene.generarMapaFotones(paseos, false, 0.0, 3, 4);
+    double paralelo = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    assert(uno.size() > 0 && uno.size() == cuatro.size());
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<float> pos(-1.0f, 1.0f);
+    FotonCercano a[10], b[10];
+    for (int q = 0; q < 100; q++) {
+        Point p(pos(gen), pos(gen), pos(gen));
+        BusquedaFotones ba = uno.nearest_neighbors(p, 0.5f, a), bb = cuatro.nearest_neighbors(p, 0.5f, b);
+        assert(ba.encontrados == bb.encontrados && ba.radio2 == bb.radio2);
+        for (std::size_t i = 0; i < ba.encontrados; i++) {
+            Point pa = uno.posicion(a[i].foton), pb = cuatro.posicion(b[i].foton);
+            RGB fa = a[i].foton->flujo(), fb = b[i].foton->flujo();
+            assert(pa.x == pb.x && pa.y == pb.y && pa.z == pb.z);
+            assert(fa.r == fb.r && fa.g == fb.g && fa.b == fb.b);
+        }
+    }
+
+    std::cout << "Photon emission (" << paseos << " paths, " << uno.size() << " photons): " << secuencial
+              << " s with 1 thread, " << paralelo << " s with 4 threads" << std::endl;
+    std::cout << "Parallel photon emission test passed!" << std::endl;
+}
+
+// Every kernel integrates to one over the unit disc, and the table follows the kernel it samples
+void test_kernels() {
+    std::vector<Kernel> kernels = {KernelCaja{}, KernelTriangular{}, KernelGaussiano{}, KernelGaussiano{0.3f},
+                                   KernelEpanechnikov{}, KernelQuartic{}, KernelTripeso{}, KernelTricubo{},
+                                   KernelCoseno{}, KernelLogistico{}, KernelSigmoide{}};
+    for (const Kernel& kernel : kernels) {
+        const int N = 20000;
+        double integral = 0.0;
+        for (int i = 0; i < N; i++) {
+            float u = (i + 0.5f) / N;
+            integral += std::visit([u](const auto& k) { return double(k(u)); }, kernel) * 2.0 * M_PI * u / N;
+        }
+        assert(std::abs(integral - 1.0) < 1e-3);
+
+        Kernel tabla = std::visit([](const auto& k) { return Kernel(KernelTabulado(k)); }, kernel);
+        for (int i = 0; i <= 1000; i++) {
+            float u = i / 1000.0f;
+            float exacto = std::visit([u](const auto& k) { return k(u); }, kernel);
+            float tabulado = std::visit([u](const auto& k) { return k(u); }, tabla);
+            assert(std::abs(exacto - tabulado) < 1e-3f);
+        }
+    }
+    std::cout << "Kernel normalisation test passed!" << std::endl;
+}
+
+namespace {
+    // n photons spread over the walls of the Cornell box of test_cornell_box.cpp
+    std::vector<FotonEmitido> fotonesCornell(std::size_t n, uint32_t seed) {
+        std::mt19937 gen(seed);
+        std::uniform_real_distribution<float> u(-1.0f, 1.0f), w(-1.0f, 2.0f);
+        std::vector<FotonEmitido> fotones;
+        fotones.reserve(n);
+        RGB flujo = RGB(8, 8, 8) / float(n);
+        for (std::size_t i = 0; i < n; i++) {
+            switch (i % 5) {
+                case 0: fotones.emplace_back(Point(1, u(gen), w(gen)), Direction(1, 0, 0), flujo); break;
+                case 1: fotones.emplace_back(Point(-1, u(gen), w(gen)), Direction(-1, 0, 0), flujo); break;
+                case 2: fotones.emplace_back(Point(u(gen), 1, w(gen)), Direction(0, 1, 0), flujo); break;
+                case 3: fotones.emplace_back(Point(u(gen), -1, w(gen)), Direction(0, -1, 0), flujo); break;
+                default: fotones.emplace_back(Point(u(gen), u(gen), 2), Direction(0, 0, 1), flujo); break;
+            }
+        }
+        return fotones;
+    }
+}
+
+// Render time of photon mapping against the size of the photon map. The map is built
+// once and shared by every render thread, so the time should only grow with the depth
+// of the tree and not with the number of photons
+void run_photon_benchmark() {
+    Scene scene = buildCornellBox();
+    const int width = 64, height = 64;
+    PinholeCamera camera(Point(0, 0, -0.5), 45, width, height);
+    Kernel kernel = KernelCaja{};
+
+    std::cout << "Photon mapping benchmark (" << width << "x" << height << ", 1 spp, k = 50)" << std::endl;
+    std::cout << "Photons\t\tBuild(s)\tRender(s)\tMB" << std::endl;
+    for (std::size_t n : {10000, 100000, 1000000, 10000000}) {
+        MapaFotones mapa = construirMapaFotones(fotonesCornell(n, 17));
+        RenderConfig config(&mapa, 50, 0.1, &kernel);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        Image image = camera.render(scene, 1, config);
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+        std::cout << n << "\t" << (n < 10000000 ? "\t" : "") << mapa.build_time() << "\t\t" << seconds
+                  << "\t\t" << mapa.memoryUsage() / (1024 * 1024) << std::endl;
+    }
+}
+
+// Caustic photons go to their own map and nowhere else
+void test_mapa_causticas() {
+    Scene scene = buildCornellBox();
+    MapaFotones todos = scene.generarMapaFotones(4000, false, 0.0, 9);
+    MapasFotones mapas = scene.generarMapasFotones(4000, 0.0, 9);
+    assert(mapas.causticos.size() > 0);
+    assert(mapas.global.size() + mapas.causticos.size() == todos.size());
+
+    // Without specular or refractive surfaces there are no caustics
+    Scene difusa;
+    difusa.addObject(std::make_shared<Plane>(Direction(0, 1, 0), Material(RGB(0.5, 0.5, 0.5)), 1));
+    difusa.addObject(std::make_shared<Plane>(Direction(0, -1, 0), Material(RGB(0.5, 0.5, 0.5)), 1));
+    difusa.addLight(std::make_shared<PointLight>(Point(0, 0, 0), RGB(1, 1, 1)));
+    MapasFotones sinCausticas = difusa.generarMapasFotones(2000, 0.0, 9);
+    assert(sinCausticas.global.size() > 0 && sinCausticas.causticos.size() == 0);
+    std::cout << "Caustic map test passed!" << std::endl;
+}
+
+// One progressive pass is a plain photon mapping render; more passes average finite images
+void test_progressive_photon_mapping() {
+    Scene scene = buildCornellBox();
+    PinholeCamera camera(Point(0, 0, -0.5), 45, 16, 16);
+    Kernel kernel = KernelCaja{};
+    RenderConfig config(nullptr, 20, 0.2, &kernel);
+    config.seed = 5;
+
+    Image progresiva = camera.renderProgressivePhotonMapping(scene, 1, 1, 2000, config);
+
+    RenderConfig pasada = config;
+    pasada.seed = PCG32::mix(config.seed);
+    pasada.kPhotons = pasada.kCaustic = 0;
+    MapasFotones mapas = scene.generarMapasFotones(2000, 0.0, pasada.seed);
+    pasada.photonMap = &mapas.global;
+    pasada.causticMap = &mapas.causticos;
+    Image unica = camera.render(scene, 1, pasada);
+    for (std::size_t i = 0; i < unica.pixels.size(); i++) {
+        const RGB& a = unica.pixels[i];
+        const RGB& b = progresiva.pixels[i];
+        assert(a.r == b.r && a.g == b.g && a.b == b.b);
+    }
+
+    Image tres = camera.renderProgressivePhotonMapping(scene, 1, 3, 2000, config);
+    for (const RGB& p : tres.pixels) assert(std::isfinite(p.r) && p.r >= 0 && std::isfinite(p.g) && std::isfinite(p.b));
+    std::cout << "Progressive photon mapping test passed!" << std::endl;
+}
+
+// Con más pasadas la imagen se acerca a la de referencia, y solo porque el radio se reduce:
+// con alpha = 1 el radio no cambia y el sesgo se queda. La caja es solo de paredes difusas
+// para que el error sea el de la estimación de densidad y no el de los rebotes especulares
+void test_progressive_photon_mapping_convergence() {
+    Scene scene;
+    Material gris(RGB(0.5, 0.5, 0.5)), rojo(RGB(0.8, 0.2, 0.2)), verde(RGB(0.2, 0.8, 0.2));
+    scene.addObject(std::make_shared<Plane>(Direction(1, 0, 0), rojo, 1));
+    scene.addObject(std::make_shared<Plane>(Direction(-1, 0, 0), verde, 1));
+    scene.addObject(std::make_shared<Plane>(Direction(0, 1, 0), gris, 1));
+    scene.addObject(std::make_shared<Plane>(Direction(0, -1, 0), gris, 1));
+    scene.addObject(std::make_shared<Plane>(Direction(0, 0, 1), gris, 2));
+    scene.addLight(std::make_shared<PointLight>(Point(0, 0.5, 0), RGB(8, 8, 8)));
+
+    const int lado = 12;
+    const unsigned spp = 8;
+    PinholeCamera camera(Point(0, 0, -0.5), 45, lado, lado);
+    Kernel kernel = KernelCaja{};
+    RenderConfig config(nullptr, 0, 0.5, &kernel);
+    config.causticRadius = 0.5;
+    config.mode = RenderingMode::SEQUENTIAL;
+
+    // Referencia: muchos fotones y un radio pequeño
+    RenderConfig referencia = config;
+    referencia.radius = referencia.causticRadius = 0.05;
+    referencia.seed = 1000;
+    MapasFotones mapas = scene.generarMapasFotones(400000, 0.0, referencia.seed);
+    referencia.photonMap = &mapas.global;
+    referencia.causticMap = &mapas.causticos;
+    Image esperada = camera.render(scene, spp, referencia);
+
+    auto error = [&](const Image& image) {
+        double suma = 0.0;
+        for (std::size_t i = 0; i < image.pixels.size(); i++) {
+            RGB d = image.pixels[i] - esperada.pixels[i];
+            suma += std::abs(d.r) + std::abs(d.g) + std::abs(d.b);
+        }
+        return suma / image.pixels.size();
+    };
+
+    double errorPocas = error(camera.renderProgressivePhotonMapping(scene, spp, 2, 4000, config));
+    double errorMuchas = error(camera.renderProgressivePhotonMapping(scene, spp, 24, 4000, config));
+    double errorRadioFijo = error(camera.renderProgressivePhotonMapping(scene, spp, 24, 4000, config, 1.0));
+    std::cout << "  Mean error: " << errorPocas << " after 2 passes, " << errorMuchas << " after 24, "
+              << errorRadioFijo << " after 24 with a fixed radius" << std::endl;
+    assert(errorMuchas < errorPocas);
+    assert(errorMuchas < errorRadioFijo);
+
+    // Varianza de cada píxel entre semillas, media sobre la imagen: baja con las pasadas
+    // aunque el radio, y con él los fotones de cada estimación, se reduzca
+    auto varianza = [&](unsigned passes) {
+        const int semillas = 4;
+        std::vector<double> suma(lado * lado, 0.0), suma2(lado * lado, 0.0);
+        for (int s = 0; s < semillas; s++) {
+            RenderConfig c = config;
+            c.seed = 77 + s;
+            Image image = camera.renderProgressivePhotonMapping(scene, spp, passes, 2000, c);
+            for (std::size_t i = 0; i < image.pixels.size(); i++) {
+                double v = image.pixels[i].r + image.pixels[i].g + image.pixels[i].b;
+                suma[i] += v;
+                suma2[i] += v * v;
+            }
+        }
+        double total = 0.0;
+        for (std::size_t i = 0; i < suma.size(); i++) {
+            double media = suma[i] / semillas;
+            total += suma2[i] / semillas - media * media;
+        }
+        return total / suma.size();
+    };
+    double varianzaUna = varianza(1), varianzaOcho = varianza(8);
+    std::cout << "  Mean pixel variance: " << varianzaUna << " after 1 pass, " << varianzaOcho << " after 8" << std::endl;
+    assert(varianzaOcho < varianzaUna);
+    std::cout << "Progressive photon mapping convergence test passed!" << std::endl;
+}
+
+void run_photon_tests() {
+    std::cout << "Running photon map tests...\n";
+    test_foton_compacto();
+    test_kernels();
+    test_kdtree_parallel_build();
+    test_busqueda_fotones();
+    test_emision_paralela();
+    test_mapa_causticas();
+    test_progressive_photon_mapping();
+    test_progressive_photon_mapping_convergence();
+}